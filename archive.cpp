@@ -0,0 +1,190 @@
+#include "archive.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "format.h"
+#include "mapped_file.h"
+#include "memory_budget.h"
+#include "parallel.h"
+#include "timed_streambuf.h"
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+
+/// Returns the file table of `members` followed by the trailer, the table being at `table_offset`.
+std::vector<char> file_table(const std::vector<ArchiveMember> &members, std::uint64_t table_offset)
+{
+    std::vector<char> table(8);
+
+    format::put_u64(table.data(), members.size());
+
+    for (const ArchiveMember &member : members)
+    {
+        char entry[format::archive_entry_size];
+
+        format::put_u64(entry, member.offset);
+        format::put_u64(entry + 8, member.compressed_size);
+        format::put_u64(entry + 16, member.original_size);
+        format::put_u16(entry + 24, static_cast<std::uint16_t> (member.name.size()));
+        table.insert(table.end(), entry, entry + sizeof entry);
+        table.insert(table.end(), member.name.begin(), member.name.end());
+    }
+
+    char trailer[format::trailer_size];
+
+    format::put_u64(trailer, table_offset);
+    std::memcpy(trailer + 8, format::archive_table_magic, sizeof format::archive_table_magic);
+    table.insert(table.end(), trailer, trailer + sizeof trailer);
+    return table;
+}
+
+} // namespace
+
+
+void create_archive(const std::vector<std::string> &paths, std::ostream &os, const Options &options)
+{
+    for (const std::string &path : paths)
+        if (path.size() > 0xffff)
+            throw std::invalid_argument("file name too long");
+
+    const Clock::time_point start {Clock::now()};
+
+    TimedStreambuf output_buffer(*os.rdbuf());
+    std::ostream output(&output_buffer);
+
+    output.exceptions(os.exceptions());
+
+    const char header[format::archive_header_size] {
+        format::archive_magic[0], format::archive_magic[1], format::archive_magic[2], format::archive_magic[3],
+        static_cast<char> (format::archive_version)
+    };
+
+    output.write(header, sizeof header);
+
+    // the threads work on different files rather than on the blocks of one
+    const std::size_t batch_size {2 * thread_count(options.threads)};
+    std::vector<std::vector<char>> compressed(batch_size);
+    std::vector<Stats> stats(batch_size);
+    std::vector<ArchiveMember> members;
+    std::uint64_t offset {format::archive_header_size};
+    Stats total;
+
+    for (std::size_t batch = 0; batch < paths.size(); batch += batch_size)
+    {
+        const std::size_t count {std::min(batch_size, paths.size() - batch)};
+
+        parallel_for(count, options.threads, [&](std::size_t b) {
+            const MappedFile input(paths[batch + b]);
+            Options member_options {options};
+
+            member_options.threads = 1;
+            member_options.stats = &stats[b];
+            compressed[b].clear();
+            compress(input.data(), input.size(), compressed[b], member_options);
+        });
+
+        for (std::size_t b = 0; b < count; ++b)
+        {
+            output.write(compressed[b].data(), static_cast<std::streamsize> (compressed[b].size()));
+            members.push_back(ArchiveMember {paths[batch + b], offset, compressed[b].size(), stats[b].bytes_in});
+            offset += compressed[b].size();
+
+            total.bytes_in += stats[b].bytes_in;
+            total.codes += stats[b].codes;
+            total.resets += stats[b].resets;
+
+            if (options.stats != nullptr && options.stats->progress != nullptr)
+                options.stats->progress->advance(stats[b].bytes_in);
+        }
+    }
+
+    const std::vector<char> table {file_table(members, offset)};
+
+    output.write(table.data(), static_cast<std::streamsize> (table.size()));
+
+    if (output.bad())
+        os.setstate(std::ios_base::badbit);
+
+    if (options.stats != nullptr)
+    {
+        const double seconds {std::chrono::duration<double>(Clock::now() - start).count()};
+
+        total.bytes_out = output_buffer.bytes();
+        total.io_seconds = output_buffer.seconds();
+        total.codec_seconds = std::max(0.0, seconds - total.io_seconds);
+        total.peak_memory = peak_memory();
+        total.progress = options.stats->progress;
+        *options.stats = total;
+
+        if (total.progress != nullptr)
+            total.progress->finish();
+    }
+}
+
+
+std::vector<ArchiveMember> read_archive_table(const char *data, std::size_t size)
+{
+    if (size < format::archive_header_size + 8 + format::trailer_size
+        || std::memcmp(data, format::archive_magic, sizeof format::archive_magic) != 0
+        || std::memcmp(data + size - 4, format::archive_table_magic, sizeof format::archive_table_magic) != 0)
+        throw std::runtime_error("not an archive");
+
+    if (static_cast<std::uint8_t> (data[4]) != format::archive_version)
+        throw std::runtime_error("unsupported archive version");
+
+    const std::size_t table_end {size - format::trailer_size};
+    const std::uint64_t table_offset {format::get_u64(data + table_end)};
+
+    if (table_offset < format::archive_header_size || table_offset > table_end
+        || table_end - table_offset < 8)
+        throw std::runtime_error("corrupted archive");
+
+    const std::uint64_t count {format::get_u64(data + table_offset)};
+
+    if (count > (table_end - table_offset - 8) / format::archive_entry_size)
+        throw std::runtime_error("corrupted archive");
+
+    std::vector<ArchiveMember> members;
+    const char *p {data + table_offset + 8};
+
+    for (std::uint64_t m = 0; m < count; ++m)
+    {
+        if (static_cast<std::size_t> (data + table_end - p) < format::archive_entry_size)
+            throw std::runtime_error("corrupted archive");
+
+        const std::size_t name_size {format::get_u16(p + 24)};
+        const char * const name {p + format::archive_entry_size};
+
+        if (static_cast<std::size_t> (data + table_end - name) < name_size)
+            throw std::runtime_error("corrupted archive");
+
+        const ArchiveMember member {
+            std::string(name, name + name_size), format::get_u64(p), format::get_u64(p + 8), format::get_u64(p + 16)
+        };
+
+        if (member.offset < format::archive_header_size || member.offset > table_offset
+            || member.compressed_size > table_offset - member.offset)
+            throw std::runtime_error("corrupted archive");
+
+        members.push_back(member);
+        p = name + name_size;
+    }
+
+    return members;
+}
+
+
+void extract_member(const char *data, std::size_t size, const ArchiveMember &member, std::ostream &os,
+                    unsigned int threads, Stats *stats)
+{
+    if (member.offset > size || member.compressed_size > size - member.offset)
+        throw std::runtime_error("corrupted archive");
+
+    decompress(data + member.offset, static_cast<std::size_t> (member.compressed_size), os, threads, stats);
+}
@@ -0,0 +1,68 @@
+#ifndef MEGALZW_ARCHIVE_H
+#define MEGALZW_ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "lzw.h"
+
+
+/**
+     * Archives of many files, each compressed on its own into a member, with
+     * a file table at the end; see format.h.
+     *
+     * Members are whole compressed files, so that one can be decompressed
+     * without reading any other: its offset and size are in the table.
+*/
+
+/// Entry of the file table of an archive.
+struct ArchiveMember
+{
+    std::string name;               ///< path of the file, as it was given to `create_archive()`
+    std::uint64_t offset;           ///< position of the member in the archive
+    std::uint64_t compressed_size;  ///< size of the member
+    std::uint64_t original_size;    ///< size of the file
+};
+
+
+/**
+     * Compresses the files at `paths` into an archive.
+     *
+     * The files are mapped into memory and compressed a batch at a time,
+     * one file per thread, each with a dictionary of its own; the members of
+     * a batch are written in order once all of them are done.
+     *
+     * @param paths        files to archive, names of at most 65535 bytes
+     * @param [out] os     output stream
+     * @param options      how to compress each file, and the number of threads compressing them
+     * @throw std::runtime_error if a file cannot be read
+*/
+void create_archive(const std::vector<std::string> &paths, std::ostream &os, const Options &options = Options());
+
+/**
+     * Reads the file table of an archive in memory.
+     *
+     * @param data     the whole archive
+     * @param size     size of the archive
+     * @return         its members, in the order they were archived
+     * @throw std::runtime_error if `data` is not an archive, or a corrupted one
+*/
+std::vector<ArchiveMember> read_archive_table(const char *data, std::size_t size);
+
+/**
+     * Decompresses one member of an archive in memory.
+     *
+     * @param data         the whole archive
+     * @param size         size of the archive
+     * @param member       entry of its file table
+     * @param [out] os     output stream
+     * @param threads      threads decoding the blocks of the member, 0 for one per hardware thread
+     * @param [out] stats  where to report what was done, or null
+*/
+void extract_member(const char *data, std::size_t size, const ArchiveMember &member, std::ostream &os,
+                    unsigned int threads = 0, Stats *stats = nullptr);
+
+#endif // MEGALZW_ARCHIVE_H
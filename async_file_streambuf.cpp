@@ -0,0 +1,822 @@
+#include "async_file_streambuf.h"
+
+#include <fstream>
+#include <utility>
+
+#include "pipelined_streambuf.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define MEGALZW_HAVE_IO_URING
+#endif
+#endif
+
+#ifdef MEGALZW_HAVE_IO_URING
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+/// `std::filebuf` opened before the stream buffer built on it, which it outlives.
+struct FileHolder
+{
+    std::filebuf file;
+};
+
+
+/// `ReadAheadStreambuf` over a file of its own, opened before it looks up its position.
+class ThreadedFileInput: private FileHolder, public ReadAheadStreambuf
+{
+public:
+
+    explicit ThreadedFileInput(FileHolder &&opened):
+        FileHolder(std::move(opened)),
+        ReadAheadStreambuf(file, async_buffers, async_buffer_size)
+    {
+    }
+};
+
+
+/// `WriteBehindStreambuf` over a file of its own, opened before it starts writing.
+class ThreadedFileOutput: private FileHolder, public WriteBehindStreambuf
+{
+public:
+
+    explicit ThreadedFileOutput(FileHolder &&opened):
+        FileHolder(std::move(opened)),
+        WriteBehindStreambuf(file, async_buffers, async_buffer_size)
+    {
+    }
+};
+
+
+std::unique_ptr<std::streambuf> open_threaded_input(const std::string &path)
+{
+    FileHolder opened;
+
+    if (opened.file.open(path, std::ios_base::in | std::ios_base::binary) == nullptr)
+        return nullptr;
+
+    return std::unique_ptr<std::streambuf>(new ThreadedFileInput(std::move(opened)));
+}
+
+
+std::unique_ptr<std::streambuf> open_threaded_output(const std::string &path)
+{
+    FileHolder opened;
+
+    if (opened.file.open(path, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary) == nullptr)
+        return nullptr;
+
+    return std::unique_ptr<std::streambuf>(new ThreadedFileOutput(std::move(opened)));
+}
+
+} // namespace
+
+
+#ifdef MEGALZW_HAVE_IO_URING
+
+namespace {
+
+/// Alignment of the buffers, offsets and sizes of `O_DIRECT` requests.
+const std::size_t direct_alignment {4096};
+
+
+/**
+     * An io_uring, set up and driven with raw system calls: requests go into
+     * the submission queue shared with the kernel, and their results come
+     * back in the completion queue, in whatever order they finish.
+*/
+class IoRing
+{
+public:
+
+    /**
+     * @param entries  most requests in flight
+     * @throw std::system_error if the kernel does not allow the ring
+    */
+    explicit IoRing(unsigned int entries):
+        sq_ {nullptr},
+        cq_ {nullptr},
+        sqes_ {nullptr}
+    {
+        io_uring_params params;
+
+        std::memset(&params, 0, sizeof params);
+        fd_ = static_cast<int> (syscall(__NR_io_uring_setup, entries, &params));
+
+        if (fd_ < 0)
+            throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof (unsigned int);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof (io_uring_cqe);
+        sqes_size_ = params.sq_entries * sizeof (io_uring_sqe);
+
+        // with a single mapping, both queues are in the larger of the two
+        const bool single {(params.features & IORING_FEAT_SINGLE_MMAP) != 0};
+
+        if (single)
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+
+        try
+        {
+            sq_ = map(sq_size_, IORING_OFF_SQ_RING);
+            cq_ = single ? sq_ : map(cq_size_, IORING_OFF_CQ_RING);
+            sqes_ = static_cast<io_uring_sqe *> (map(sqes_size_, IORING_OFF_SQES));
+        }
+        catch (...)
+        {
+            release();
+            throw;
+        }
+
+        char * const sq {static_cast<char *> (sq_)};
+        char * const cq {static_cast<char *> (cq_)};
+
+        sq_tail_ = reinterpret_cast<unsigned int *> (sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned int *> (sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned int *> (sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned int *> (cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned int *> (cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned int *> (cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *> (cq + params.cq_off.cqes);
+    }
+
+    ~IoRing()
+    {
+        release();
+    }
+
+    IoRing(const IoRing &) = delete;
+    IoRing &operator=(const IoRing &) = delete;
+
+    /**
+     * Submits a read or a write.
+     *
+     * @param opcode       `IORING_OP_READV` or `IORING_OP_WRITEV`
+     * @param fd           file
+     * @param iov          the buffer, which must stay as it is until the request completes
+     * @param offset       position in the file
+     * @param user_data    returned with the result
+    */
+    void submit(std::uint8_t opcode, int fd, const iovec *iov, std::uint64_t offset, std::uint64_t user_data)
+    {
+        const unsigned int tail {*sq_tail_};
+        const unsigned int index {tail & sq_mask_};
+        io_uring_sqe &sqe = sqes_[index];
+
+        std::memset(&sqe, 0, sizeof sqe);
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t> (iov);
+        sqe.len = 1;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array_[index] = index;
+
+        // the kernel may read the entry as soon as it sees the new tail
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+        if (syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0) < 0)
+            throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+    }
+
+    /**
+     * Waits for a request to complete.
+     *
+     * @param [out] result     what the read or write returned, or minus its `errno`
+     * @return                 the user data of the request
+    */
+    std::uint64_t wait(std::int32_t &result)
+    {
+        while (true)
+        {
+            const unsigned int head {*cq_head_};
+
+            if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+            {
+                const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+                const std::uint64_t user_data {cqe.user_data};
+
+                result = cqe.res;
+                __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                return user_data;
+            }
+
+            if (syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+        }
+    }
+
+private:
+
+    void *map(std::size_t size, off_t offset)
+    {
+        void * const p {mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset)};
+
+        if (p == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "io_uring mmap");
+
+        return p;
+    }
+
+    /// Unmaps the queues mapped so far, and closes the ring.
+    void release()
+    {
+        if (sqes_ != nullptr)
+            munmap(sqes_, sqes_size_);
+
+        if (cq_ != nullptr && cq_ != sq_)
+            munmap(cq_, cq_size_);
+
+        if (sq_ != nullptr)
+            munmap(sq_, sq_size_);
+
+        close(fd_);
+    }
+
+    int fd_;
+    void *sq_;
+    void *cq_;
+    io_uring_sqe *sqes_;
+    std::size_t sq_size_;
+    std::size_t cq_size_;
+    std::size_t sqes_size_;
+    unsigned int *sq_tail_;
+    unsigned int sq_mask_;
+    unsigned int *sq_array_;
+    unsigned int *cq_head_;
+    unsigned int *cq_tail_;
+    unsigned int cq_mask_;
+    io_uring_cqe *cqes_;
+};
+
+
+/// Buffers of the requests in flight, aligned for `O_DIRECT`.
+class AlignedBuffers
+{
+public:
+
+    AlignedBuffers(std::size_t count, std::size_t size):
+        data_ {nullptr}
+    {
+        if (posix_memalign(&data_, direct_alignment, count * size) != 0)
+            throw std::bad_alloc();
+    }
+
+    ~AlignedBuffers()
+    {
+        std::free(data_);
+    }
+
+    AlignedBuffers(const AlignedBuffers &) = delete;
+    AlignedBuffers &operator=(const AlignedBuffers &) = delete;
+
+    char *get() const
+    {
+        return static_cast<char *> (data_);
+    }
+
+private:
+
+    void *data_;
+};
+
+
+/// A buffer of the ring and the request it is in.
+struct Request
+{
+    iovec iov;              ///< the part of the buffer the request is for
+    char *data;             ///< the buffer
+    std::uint64_t offset;   ///< position in the file of the start of the buffer
+    std::size_t size;       ///< bytes read into or written from the buffer so far
+    std::size_t wanted;     ///< bytes the request is for, from the start of the buffer
+    int error;              ///< `errno` of a failed request, 0 if none
+    bool busy;              ///< whether the request is in flight
+};
+
+
+/// Opens `path` with `flags`, and `O_DIRECT` as well if the file system allows it.
+int open_direct(const std::string &path, int flags, bool &direct)
+{
+    int fd {open(path.c_str(), flags | O_DIRECT | O_CLOEXEC, 0666)};
+
+    direct = fd >= 0;
+
+    if (fd < 0 && errno == EINVAL)
+        fd = open(path.c_str(), flags | O_CLOEXEC, 0666);
+
+    return fd;
+}
+
+
+/// Turns `O_DIRECT` off for the requests submitted from then on; returns false if it could not.
+bool drop_direct(int fd)
+{
+    const int flags {fcntl(fd, F_GETFL)};
+
+    return flags != -1 && fcntl(fd, F_SETFL, flags & ~O_DIRECT) != -1;
+}
+
+
+/**
+     * Stream buffer reading a file through an io_uring, every buffer of the
+     * ring being read ahead at once, in order.
+     *
+     * The get area is the buffer of the next request in order; once it is
+     * used up, its buffer is submitted again for the data after the last
+     * buffer in flight. A read shorter than asked for is the end of the file.
+*/
+class UringInput: public std::streambuf
+{
+public:
+
+    UringInput(int fd, bool direct):
+        fd_ {fd},
+        direct_ {direct},
+        ring_(async_buffers),
+        storage_(async_buffers, async_buffer_size),
+        requests_(async_buffers),
+        current_ {0},
+        next_offset_ {0},
+        position_ {0},
+        skip_ {0},
+        started_ {false},
+        reading_ {false},
+        end_ {false}
+    {
+        for (std::size_t b = 0; b < requests_.size(); ++b)
+            requests_[b] = Request {{nullptr, 0}, storage_.get() + b * async_buffer_size, 0, 0, 0, 0, false};
+    }
+
+    ~UringInput()
+    {
+        try
+        {
+            stop();
+        }
+        catch (...)
+        {
+        }
+
+        close(fd_);
+    }
+
+protected:
+
+    int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        if (reading_)
+        {
+            Request &used = requests_[current_];
+
+            position_ = used.offset + used.size;
+            setg(nullptr, nullptr, nullptr);
+            reading_ = false;
+
+            if (!end_)
+            {
+                read(used, next_offset_);
+                next_offset_ += async_buffer_size;
+            }
+
+            current_ = (current_ + 1) % requests_.size();
+        }
+
+        if (!started_)
+            start();
+
+        Request &request = requests_[current_];
+
+        while (request.busy)
+            complete();
+
+        if (request.error != 0)
+            throw std::system_error(request.error, std::generic_category(), "read");
+
+        // past the end of the file, the buffer stays next, and the position where the data ended
+        if (request.size <= skip_)
+            return traits_type::eof();
+
+        // the first buffer after a seek starts at the aligned position before it
+        setg(request.data, request.data + skip_, request.data + request.size);
+        reading_ = true;
+        position_ = request.offset;
+        skip_ = 0;
+
+        return traits_type::to_int_type(*gptr());
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+    {
+        const pos_type current {static_cast<off_type> (position_ + (reading_ ? gptr() - eback() : 0))};
+
+        if (dir == std::ios_base::cur)
+            return off == 0 ? current : seekpos(current + off, which);
+
+        if (dir == std::ios_base::beg)
+            return seekpos(pos_type(off), which);
+
+        struct stat status;
+
+        if (fstat(fd_, &status) != 0)
+            return pos_type(off_type(-1));
+
+        return seekpos(pos_type(static_cast<off_type> (status.st_size) + off), which);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        if ((which & std::ios_base::in) == 0 || pos < 0)
+            return pos_type(off_type(-1));
+
+        stop();
+        position_ = static_cast<std::uint64_t> (off_type(pos));
+        return pos;
+    }
+
+private:
+
+    /// Submits a read of a whole buffer at `offset`.
+    void read(Request &request, std::uint64_t offset)
+    {
+        request.offset = offset;
+        request.size = 0;
+        request.wanted = async_buffer_size;
+        request.error = 0;
+        submit(request);
+    }
+
+    /// Submits the rest of the read of `request`.
+    void submit(Request &request)
+    {
+        request.iov.iov_base = request.data + request.size;
+        request.iov.iov_len = request.wanted - request.size;
+        request.busy = true;
+        ring_.submit(IORING_OP_READV, fd_, &request.iov, request.offset + request.size,
+                     static_cast<std::uint64_t> (&request - requests_.data()));
+    }
+
+    /// Waits for the next read to complete, of whichever buffer.
+    void complete()
+    {
+        std::int32_t result;
+        Request &request = requests_[ring_.wait(result)];
+
+        request.busy = false;
+
+        // some file systems open files with `O_DIRECT` but refuse to read them so
+        if (result == -EINVAL && direct_ && drop_direct(fd_))
+        {
+            direct_ = false;
+            submit(request);
+            return;
+        }
+
+        if (result < 0)
+        {
+            request.error = -result;
+            end_ = true;
+            return;
+        }
+
+        request.size += static_cast<std::size_t> (result);
+
+        if (request.size == request.wanted)
+            return;
+
+        // the rest of a short read, unless it is the end of the file
+        if (result != 0 && (!direct_ || request.size % direct_alignment == 0))
+        {
+            submit(request);
+            return;
+        }
+
+        end_ = true;
+    }
+
+    /// Submits every buffer, from the position of the reader.
+    void start()
+    {
+        const std::uint64_t first {direct_ ? position_ / direct_alignment * direct_alignment : position_};
+
+        skip_ = static_cast<std::size_t> (position_ - first);
+        next_offset_ = first;
+        end_ = false;
+        current_ = 0;
+
+        for (Request &request : requests_)
+        {
+            read(request, next_offset_);
+            next_offset_ += async_buffer_size;
+        }
+
+        started_ = true;
+    }
+
+    /// Waits for the reads in flight, and drops what they read.
+    void stop()
+    {
+        for (const Request &request : requests_)
+            while (request.busy)
+                complete();
+
+        if (reading_)
+            position_ += gptr() - eback();
+
+        setg(nullptr, nullptr, nullptr);
+        reading_ = false;
+        started_ = false;
+    }
+
+    int fd_;
+    bool direct_;               ///< whether the file is opened with `O_DIRECT`
+    IoRing ring_;
+    AlignedBuffers storage_;
+    std::vector<Request> requests_;
+    std::size_t current_;       ///< request of the get area, or of the next one
+    std::uint64_t next_offset_; ///< position in the file of the next buffer to submit
+    std::uint64_t position_;    ///< position in the file of the start of the get area, or of the next byte
+    std::size_t skip_;          ///< bytes before the position of the reader in the first buffer
+    bool started_;              ///< whether the buffers are submitted
+    bool reading_;              ///< whether the get area is a buffer of the ring
+    bool end_;                  ///< whether a read reached the end of the file, so that no more are submitted
+};
+
+
+/**
+     * Stream buffer writing a file through an io_uring.
+     *
+     * The put area is a buffer of the ring; once it is full, it is submitted
+     * and the next buffer whose write has completed becomes the put area.
+     * The last buffer is rarely full, and `O_DIRECT` only writes whole
+     * blocks, so it is written once the file is back to buffered writes.
+*/
+class UringOutput: public std::streambuf
+{
+public:
+
+    UringOutput(int fd, bool direct):
+        fd_ {fd},
+        direct_ {direct},
+        ring_(async_buffers),
+        storage_(async_buffers, async_buffer_size),
+        requests_(async_buffers),
+        current_ {0},
+        offset_ {0},
+        failed_ {false}
+    {
+        for (std::size_t b = 0; b < requests_.size(); ++b)
+            requests_[b] = Request {{nullptr, 0}, storage_.get() + b * async_buffer_size, 0, 0, 0, 0, false};
+
+        setp(requests_[0].data, requests_[0].data + async_buffer_size);
+    }
+
+    /// Writes what is left, without reporting errors.
+    ~UringOutput()
+    {
+        try
+        {
+            sync();
+        }
+        catch (...)
+        {
+        }
+
+        close(fd_);
+    }
+
+protected:
+
+    int_type overflow(int_type c) override
+    {
+        if (failed_)
+            return traits_type::eof();
+
+        hand_off();
+
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override
+    {
+        const std::size_t size {static_cast<std::size_t> (pptr() - pbase())};
+
+        if (size != 0 && !failed_)
+        {
+            // a partial buffer ends the whole blocks, so the rest of the file is written through the page cache
+            if (direct_ && size % direct_alignment != 0)
+            {
+                drain();
+
+                if (!drop_direct(fd_))
+                    failed_ = true;
+
+                direct_ = false;
+            }
+
+            hand_off();
+        }
+
+        drain();
+        return failed_ ? -1 : 0;
+    }
+
+private:
+
+    /// Submits the put area, and makes the next buffer, once its write has completed, the put area.
+    void hand_off()
+    {
+        Request &request = requests_[current_];
+
+        request.offset = offset_;
+        request.size = 0;
+        request.wanted = static_cast<std::size_t> (pptr() - pbase());
+        offset_ += request.wanted;
+
+        if (request.wanted != 0 && !failed_)
+            submit(request);
+
+        current_ = (current_ + 1) % requests_.size();
+
+        Request &next = requests_[current_];
+
+        while (next.busy)
+            complete();
+
+        setp(next.data, next.data + async_buffer_size);
+    }
+
+    /// Submits the rest of the write of `request`.
+    void submit(Request &request)
+    {
+        request.iov.iov_base = request.data + request.size;
+        request.iov.iov_len = request.wanted - request.size;
+        request.busy = true;
+        ring_.submit(IORING_OP_WRITEV, fd_, &request.iov, request.offset + request.size,
+                     static_cast<std::uint64_t> (&request - requests_.data()));
+    }
+
+    /// Waits for the next write to complete, of whichever buffer.
+    void complete()
+    {
+        std::int32_t result;
+        Request &request = requests_[ring_.wait(result)];
+
+        request.busy = false;
+
+        if (result == -EINVAL && direct_ && drop_direct(fd_))
+        {
+            direct_ = false;
+            submit(request);
+            return;
+        }
+
+        if (result <= 0)
+        {
+            failed_ = true;
+            return;
+        }
+
+        request.size += static_cast<std::size_t> (result);
+
+        if (request.size == request.wanted)
+            return;
+
+        // the rest of a short write, which `O_DIRECT` only takes in whole blocks
+        if (!direct_ || request.size % direct_alignment == 0)
+            submit(request);
+        else
+            failed_ = true;
+    }
+
+    /// Waits for every write in flight.
+    void drain()
+    {
+        for (const Request &request : requests_)
+            while (request.busy)
+                complete();
+    }
+
+    int fd_;
+    bool direct_;               ///< whether the file is opened with `O_DIRECT`
+    IoRing ring_;
+    AlignedBuffers storage_;
+    std::vector<Request> requests_;
+    std::size_t current_;       ///< request of the put area
+    std::uint64_t offset_;      ///< position in the file of the start of the put area
+    bool failed_;               ///< whether a write failed
+};
+
+} // namespace
+
+
+bool async_io_supported()
+{
+    static const bool supported {[] {
+        try
+        {
+            IoRing ring(1);
+
+            return true;
+        }
+        catch (const std::system_error &)
+        {
+            return false;
+        }
+    }()};
+
+    return supported;
+}
+
+
+std::unique_ptr<std::streambuf> open_async_input(const std::string &path)
+{
+    if (!async_io_supported())
+        return open_threaded_input(path);
+
+    bool direct;
+    const int fd {open_direct(path, O_RDONLY, direct)};
+
+    if (fd < 0)
+        return nullptr;
+
+    try
+    {
+        return std::unique_ptr<std::streambuf>(new UringInput(fd, direct));
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+}
+
+
+std::unique_ptr<std::streambuf> open_async_output(const std::string &path)
+{
+    if (!async_io_supported())
+        return open_threaded_output(path);
+
+    bool direct;
+    const int fd {open_direct(path, O_WRONLY | O_CREAT | O_TRUNC, direct)};
+
+    if (fd < 0)
+        return nullptr;
+
+    try
+    {
+        return std::unique_ptr<std::streambuf>(new UringOutput(fd, direct));
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+}
+
+#else
+
+bool async_io_supported()
+{
+    return false;
+}
+
+
+std::unique_ptr<std::streambuf> open_async_input(const std::string &path)
+{
+    return open_threaded_input(path);
+}
+
+
+std::unique_ptr<std::streambuf> open_async_output(const std::string &path)
+{
+    return open_threaded_output(path);
+}
+
+#endif // MEGALZW_HAVE_IO_URING
@@ -0,0 +1,55 @@
+#ifndef MEGALZW_ASYNC_FILE_STREAMBUF_H
+#define MEGALZW_ASYNC_FILE_STREAMBUF_H
+
+#include <cstddef>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+
+/**
+     * Stream buffers over files that keep several large reads or writes in
+     * flight, so that the codec, and the blocks it compresses in parallel,
+     * never wait on a single synchronous system call.
+     *
+     * On Linux they submit the requests to an io_uring, to files opened with
+     * `O_DIRECT` where the file system allows it, so that the data goes
+     * between the disk and the buffers without the page cache. Elsewhere, or
+     * where the kernel refuses io_uring, they fall back on the threads of a
+     * `ReadAheadStreambuf` or `WriteBehindStreambuf` over a `std::filebuf`.
+*/
+
+/// Size of each request in flight, a multiple of the alignment `O_DIRECT` needs.
+const std::size_t async_buffer_size {1024 * 1024};
+
+/// Number of requests in flight.
+const std::size_t async_buffers {8};
+
+
+/// Returns whether the stream buffers below use io_uring rather than threads.
+bool async_io_supported();
+
+/**
+     * Opens the file at `path` for reading ahead of the reader.
+     *
+     * The stream buffer can seek, which stops the reads in flight and starts
+     * them over from the new position.
+     *
+     * @param path     file to read
+     * @return         the stream buffer, or null if the file could not be opened
+*/
+std::unique_ptr<std::streambuf> open_async_input(const std::string &path);
+
+/**
+     * Creates or truncates the file at `path` for writing behind the writer.
+     *
+     * Failed writes are reported by the next `overflow()` or `sync()`, so
+     * flushing the stream before destroying the buffer is what makes sure
+     * that everything was written.
+     *
+     * @param path     file to write
+     * @return         the stream buffer, or null if the file could not be opened
+*/
+std::unique_ptr<std::streambuf> open_async_output(const std::string &path);
+
+#endif // MEGALZW_ASYNC_FILE_STREAMBUF_H
@@ -0,0 +1,499 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lzw.h"
+
+
+/**
+     * Prints usage information and a custom error message.
+     *
+     * @param s    custom error message to be printed
+*/
+void print_usage(const std::string &s = "")
+{
+    if (!s.empty())
+        std::cerr << "\nERROR: " << s << '\n';
+
+    std::cerr << "\nUsage:\n";
+    std::cerr << "\tmegalzw_benchmark [options] [file...]\n\n";
+    std::cerr << "Measures compress() and decompress() on generated data of every corpus and size,\n";
+    std::cerr << "and on every `file' as it is.\n\n";
+    std::cerr << "Options:\n";
+    std::cerr << "\t--corpus=LIST           any of bmp,text,random,zero (default: all of them)\n";
+    std::cerr << "\t--sizes=LIST            sizes of the generated data (default: 4K,64K,1M,16M)\n";
+    std::cerr << "\t--repeat=N              runs of each measurement (default: 5)\n";
+    std::cerr << "\t--levels[=LIST]         measure the settings of the levels, of all of them without LIST,\n";
+    std::cerr << "\t                        instead of the options below but `--threads'\n";
+    std::cerr << "\t--dictionary=flat|map   compressor dictionary engine (default: flat)\n";
+    std::cerr << "\t--bits=12|16|20|24      maximum code width (default: 16)\n";
+    std::cerr << "\t--adaptive-reset        clear a full dictionary once the ratio gets worse\n";
+    std::cerr << "\t--lru                   replace the least recently used leaves of a full dictionary\n";
+    std::cerr << "\t--bmp-filter            delta-code and split the color channels of BMP images first\n";
+    std::cerr << "\t--block-size=SIZE       compress blocks of SIZE bytes independently\n";
+    std::cerr << "\t--no-checksums          leave the CRC-32C checksums out of the blocks\n";
+    std::cerr << "\t--threads=N             threads compressing or decompressing blocks\n\n";
+    std::cerr << "Examples:\n";
+    std::cerr << "\tmegalzw_benchmark --sizes=4K,1G --repeat=3 cmake-build-debug/bmp5x.bmp\n";
+    std::cerr << "\tmegalzw_benchmark --levels=1,4 --sizes=16M\n";
+    std::cerr << std::endl;
+}
+
+/**
+     * Parses a byte count such as `4096`, `64K` or `4M`.
+     *
+     * @param s    number, optionally followed by K, M or G
+     * @return     the byte count, or 0 if `s` is not one
+*/
+std::size_t parse_size(const std::string &s)
+{
+    char *end;
+    std::size_t n {std::strtoull(s.c_str(), &end, 10)};
+
+    switch (*end)
+    {
+        case 'G': n *= 1024;  // fall through
+        case 'M': n *= 1024;  // fall through
+        case 'K': n *= 1024; ++end; break;
+        default: break;
+    }
+
+    return *end == '\0' ? n : 0;
+}
+
+/// Splits `s` at every comma.
+std::vector<std::string> split(const std::string &s)
+{
+    std::vector<std::string> parts;
+    std::size_t first {0};
+
+    for (std::size_t comma; (comma = s.find(',', first)) != std::string::npos; first = comma + 1)
+        parts.push_back(s.substr(first, comma - first));
+
+    parts.push_back(s.substr(first));
+    return parts;
+}
+
+/// Formats a byte count with the largest of the K, M and G suffixes that divides it.
+std::string format_size(std::size_t n)
+{
+    const char *suffix {""};
+
+    for (const char *s : {"K", "M", "G"})
+    {
+        if (n < 1024 || n % 1024 != 0)
+            break;
+
+        n /= 1024;
+        suffix = s;
+    }
+
+    return std::to_string(n) + suffix;
+}
+
+
+/**
+     * Generates a 24-bit BMP image of `size` bytes: smooth gradients with faint
+     * noise, crossed by flat-coloured bands, which is roughly what photos and
+     * screenshots give a compressor.
+*/
+std::vector<char> make_bmp(std::size_t size)
+{
+    const std::size_t header_size {54};
+    std::vector<char> data(std::max(size, header_size));
+
+    // a 4:3 image whose rows, padded to 4 bytes, fill the rest of the file
+    const std::size_t pixels {(data.size() - header_size) / 3};
+    const std::size_t width {std::max<std::size_t> (1, static_cast<std::size_t> (std::sqrt(pixels * 4.0 / 3.0)))};
+    const std::size_t row_size {(3 * width + 3) / 4 * 4};
+    const std::size_t height {(data.size() - header_size) / row_size};
+
+    const auto put = [&](std::size_t at, std::uint32_t v, int n) {
+        for (int b = 0; b < n; ++b)
+            data[at + b] = static_cast<char> (v >> (8 * b));
+    };
+
+    data[0] = 'B';
+    data[1] = 'M';
+    put(2, static_cast<std::uint32_t> (data.size()), 4);
+    put(10, header_size, 4);
+    put(14, 40, 4);
+    put(18, static_cast<std::uint32_t> (width), 4);
+    put(22, static_cast<std::uint32_t> (height), 4);
+    put(26, 1, 2);
+    put(28, 24, 2);
+    put(34, static_cast<std::uint32_t> (row_size * height), 4);
+
+    std::mt19937 rng(1);
+
+    for (std::size_t y = 0; y < height; ++y)
+    {
+        char * const row {&data[header_size + y * row_size]};
+        const bool band {(y / 16) % 5 == 0};
+
+        for (std::size_t x = 0; x < width; ++x)
+        {
+            const unsigned int noise {static_cast<unsigned int> (rng() % 4)};
+
+            row[3 * x] = static_cast<char> (band ? 40 : 255 * x / width + noise);
+            row[3 * x + 1] = static_cast<char> (band ? 200 : 255 * y / (height + 1) + noise);
+            row[3 * x + 2] = static_cast<char> (band ? 90 : (x + y) / 4 + noise);
+        }
+    }
+
+    return data;
+}
+
+/// Generates `size` bytes of English-like text, words drawn with a skewed distribution.
+std::vector<char> make_text(std::size_t size)
+{
+    static const char * const words[] {
+        "the", "of", "and", "to", "a", "in", "is", "it", "that", "was", "for", "on", "are", "with",
+        "as", "be", "at", "by", "this", "from", "or", "have", "an", "they", "which", "one", "you",
+        "were", "all", "we", "when", "there", "can", "more", "if", "no", "out", "so", "said", "what",
+        "up", "its", "about", "into", "than", "them", "only", "some", "could", "time", "these", "two",
+        "may", "first", "then", "do", "any", "like", "my", "now", "over", "such", "our", "man", "me",
+        "even", "most", "made", "after", "also", "did", "many", "before", "must", "through", "back",
+        "years", "where", "much", "your", "way", "well", "down", "should", "because", "each", "just",
+        "those", "people", "how", "too", "little", "state", "good", "very", "make", "world", "still",
+        "dictionary", "compression", "stream", "block", "code", "width", "file", "buffer", "memory"
+    };
+
+    const std::size_t count {sizeof words / sizeof words[0]};
+    std::mt19937 rng(2);
+    std::vector<char> data;
+
+    data.reserve(size + 16);
+
+    while (data.size() < size)
+    {
+        // the product of two uniform draws favours the common words at the front
+        const std::size_t w {(rng() % count) * (rng() % count) / count};
+
+        data.insert(data.end(), words[w], words[w] + std::char_traits<char>::length(words[w]));
+        data.push_back(rng() % 12 == 0 ? '\n' : ' ');
+    }
+
+    data.resize(size);
+    return data;
+}
+
+/// Generates `size` uniformly random bytes, which no compressor can shrink.
+std::vector<char> make_random(std::size_t size)
+{
+    std::mt19937_64 rng(3);
+    std::vector<char> data(size);
+
+    for (std::size_t n = 0; n < size; n += 8)
+    {
+        const std::uint64_t v {rng()};
+
+        for (std::size_t b = 0; b < 8 && n + b < size; ++b)
+            data[n + b] = static_cast<char> (v >> (8 * b));
+    }
+
+    return data;
+}
+
+/// Generates the data of corpus `corpus`, of `size` bytes.
+std::vector<char> make_corpus(const std::string &corpus, std::size_t size)
+{
+    if (corpus == "bmp")
+        return make_bmp(size);
+
+    if (corpus == "text")
+        return make_text(size);
+
+    if (corpus == "random")
+        return make_random(size);
+
+    return std::vector<char>(size, '\0');
+}
+
+
+/// Returns the value below which `percent` per cent of the sorted `values` lie, by nearest rank.
+double percentile(const std::vector<double> &values, unsigned int percent)
+{
+    const std::size_t rank {(values.size() * percent + 99) / 100};
+
+    return values[rank == 0 ? 0 : rank - 1];
+}
+
+/// Describes the settings of `options` on one line.
+std::string describe(const Options &options)
+{
+    return "bits " + std::to_string(options.bits)
+           + ", dictionary " + (options.engine == DictionaryEngine::Map ? "map" : "flat")
+           + (options.full_dictionary == FullDictionary::Clear ? ", adaptive reset" : "")
+           + (options.full_dictionary == FullDictionary::Recycle ? ", LRU replacement" : "")
+           + (options.bmp_filter ? ", BMP filter" : "")
+           + ", block size " + (options.block_size == 0 ? std::string("none") : format_size(options.block_size))
+           + (options.block_size != 0 && !options.checksums ? ", no checksums" : "");
+}
+
+/**
+     * Compresses and decompresses `data` `repeat` times, checks the round trip,
+     * and prints one line of results.
+     *
+     * @param name     what the data is
+     * @param data     original data
+     * @param options  how to compress
+     * @param repeat   number of runs of each measurement
+*/
+void measure(const std::string &name, const std::vector<char> &data, const Options &options, unsigned int repeat)
+{
+    using clock = std::chrono::steady_clock;
+
+    std::vector<double> compress_speed;
+    std::vector<double> decompress_speed;
+    std::vector<char> compressed;
+    std::vector<char> original;
+
+    const double megabytes {data.size() / (1024.0 * 1024.0)};
+
+    for (unsigned int r = 0; r < repeat; ++r)
+    {
+        compressed.clear();
+
+        const clock::time_point start {clock::now()};
+
+        compress(data.data(), data.size(), compressed, options);
+
+        const clock::time_point middle {clock::now()};
+
+        original.clear();
+        decompress(compressed.data(), compressed.size(), original, options.threads);
+
+        const clock::time_point end {clock::now()};
+
+        if (original != data)
+            throw std::runtime_error(name + " did not survive the round trip");
+
+        compress_speed.push_back(megabytes / std::chrono::duration<double>(middle - start).count());
+        decompress_speed.push_back(megabytes / std::chrono::duration<double>(end - middle).count());
+    }
+
+    std::sort(compress_speed.begin(), compress_speed.end());
+    std::sort(decompress_speed.begin(), decompress_speed.end());
+
+    const double ratio {data.empty() ? 0.0 : static_cast<double> (compressed.size()) / data.size()};
+
+    std::cout << std::left << std::setw(24) << name << std::right
+              << std::setw(12) << compressed.size()
+              << std::setw(8) << std::setprecision(3) << std::fixed << ratio;
+
+    for (const std::vector<double> *speed : {&compress_speed, &decompress_speed})
+        for (unsigned int percent : {10u, 50u, 90u})
+            std::cout << std::setw(9) << std::setprecision(1) << percentile(*speed, percent);
+
+    std::cout << std::endl;
+}
+
+
+/**
+ *  Benchmark entry point.
+ *
+ * @param argc      number of command line arguments
+ * @param argv      array of command line arguments
+ * @return          EXIT_FAILURE    for failed operation
+ * @return          EXIT_SUCCESS    for successful operation
+ *
+ */
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> corpora {"bmp", "text", "random", "zero"};
+    std::vector<std::size_t> sizes {4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+    unsigned int repeat {5};
+    Options options;
+    std::vector<unsigned int> levels;
+    std::vector<std::string> files;
+
+    for (int a = 1; a < argc; ++a)
+    {
+        const std::string arg {argv[a]};
+
+        if (arg.compare(0, 9, "--corpus=") == 0)
+        {
+            corpora = split(arg.substr(9));
+
+            for (const std::string &corpus : corpora)
+                if (corpus != "bmp" && corpus != "text" && corpus != "random" && corpus != "zero")
+                {
+                    print_usage(std::string("corpus `") + corpus + "' is not recognized.");
+                    return EXIT_FAILURE;
+                }
+        }
+        else
+        if (arg.compare(0, 8, "--sizes=") == 0)
+        {
+            sizes.clear();
+
+            for (const std::string &size : split(arg.substr(8)))
+            {
+                sizes.push_back(parse_size(size));
+
+                if (sizes.back() == 0)
+                {
+                    print_usage(std::string("size `") + size + "' is not supported.");
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        else
+        if (arg.compare(0, 9, "--repeat=") == 0)
+        {
+            repeat = static_cast<unsigned int> (std::strtoul(arg.c_str() + 9, nullptr, 10));
+
+            if (repeat == 0)
+            {
+                print_usage(std::string("repeat count `") + arg.substr(9) + "' is not supported.");
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        if (arg == "--levels")
+        {
+            levels.clear();
+
+            for (unsigned int level = fastest_level; level <= best_level; ++level)
+                levels.push_back(level);
+        }
+        else
+        if (arg.compare(0, 9, "--levels=") == 0)
+        {
+            levels.clear();
+
+            for (const std::string &level : split(arg.substr(9)))
+            {
+                levels.push_back(static_cast<unsigned int> (std::strtoul(level.c_str(), nullptr, 10)));
+
+                if (levels.back() < fastest_level || levels.back() > best_level)
+                {
+                    print_usage(std::string("level `") + level + "' is not supported.");
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        else
+        if (arg == "--dictionary=flat" || arg == "--dictionary=map")
+            options.engine = arg == "--dictionary=map" ? DictionaryEngine::Map : DictionaryEngine::Flat;
+        else
+        if (arg.compare(0, 7, "--bits=") == 0)
+        {
+            options.bits = static_cast<unsigned int> (std::strtoul(arg.c_str() + 7, nullptr, 10));
+
+            if (!supported_code_width(options.bits))
+            {
+                print_usage(std::string("code width `") + arg.substr(7) + "' is not supported.");
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        if (arg == "--adaptive-reset")
+            options.full_dictionary = FullDictionary::Clear;
+        else
+        if (arg == "--lru")
+            options.full_dictionary = FullDictionary::Recycle;
+        else
+        if (arg == "--bmp-filter")
+            options.bmp_filter = true;
+        else
+        if (arg.compare(0, 13, "--block-size=") == 0)
+        {
+            options.block_size = parse_size(arg.substr(13));
+
+            if (options.block_size == 0 || options.block_size > max_block_size)
+            {
+                print_usage(std::string("block size `") + arg.substr(13) + "' is not supported.");
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        if (arg == "--no-checksums")
+            options.checksums = false;
+        else
+        if (arg.compare(0, 10, "--threads=") == 0)
+            options.threads = static_cast<unsigned int> (std::strtoul(arg.c_str() + 10, nullptr, 10));
+        else
+        if (arg.compare(0, 2, "--") == 0)
+        {
+            print_usage(std::string("option `") + arg + "' is not recognized.");
+            return EXIT_FAILURE;
+        }
+        else
+            files.push_back(arg);
+    }
+
+#ifndef NDEBUG
+    std::cout << "warning: assertions are enabled, this is probably not an optimized build\n";
+#endif
+
+    // the options alone, or the settings of every level asked for but their threads, one table each
+    std::vector<std::pair<std::string, Options>> settings;
+
+    if (levels.empty())
+        settings.emplace_back(std::string(), options);
+
+    for (unsigned int level : levels)
+    {
+        settings.emplace_back("level " + std::to_string(level) + ": ", level_options(level));
+        settings.back().second.threads = options.threads;
+    }
+
+    std::vector<std::pair<std::string, std::vector<char>>> inputs;
+
+    for (const std::string &path : files)
+    {
+        std::ifstream file(path, std::ios_base::binary);
+
+        if (!file.is_open())
+        {
+            print_usage(std::string("file `") + path + "' could not be opened.");
+            return EXIT_FAILURE;
+        }
+
+        inputs.emplace_back(path.substr(path.find_last_of("/\\") + 1),
+                            std::vector<char> {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()});
+    }
+
+    try
+    {
+        for (const std::pair<std::string, Options> &s : settings)
+        {
+            if (&s != &settings.front())
+                std::cout << '\n';
+
+            std::cout << s.first << describe(s.second) << ", " << repeat << " runs\n\n";
+
+            std::cout << std::left << std::setw(24) << "data" << std::right
+                      << std::setw(12) << "compressed" << std::setw(8) << "ratio"
+                      << std::setw(27) << "compress MB/s p10/50/90"
+                      << std::setw(27) << "decompress MB/s p10/50/90" << '\n';
+
+            for (const std::string &corpus : corpora)
+                for (std::size_t size : sizes)
+                    measure(corpus + ' ' + format_size(size), make_corpus(corpus, size), s.second, repeat);
+
+            for (const std::pair<std::string, std::vector<char>> &input : inputs)
+                measure(input.first, input.second, s.second, repeat);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        print_usage(std::string("Caught exception: ") + e.what() + '.');
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
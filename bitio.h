@@ -0,0 +1,251 @@
+#ifndef MEGALZW_BITIO_H
+#define MEGALZW_BITIO_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+
+/// Smallest width, in bits, of a code in a variable-width stream.
+const unsigned int min_code_width {9};
+
+
+/**
+     * Packs codes of varying widths into bytes, least significant bit first.
+     *
+     * Codes are collected in a 64-bit accumulator and leave it 32 bits at a time
+     * into a byte buffer. The buffer is either a chunk that is written to a
+     * stream whenever it fills up, or a vector that the codes are appended to.
+*/
+class CodeWriter
+{
+public:
+
+    /// Writes the codes to `os`.
+    explicit CodeWriter(std::ostream &os):
+        os_ {&os},
+        chunk_(chunk_size),
+        out_(chunk_),
+        used_ {0},
+        accumulator_ {0},
+        bits_ {0}
+    {
+    }
+
+    /// Appends the codes to `out`.
+    explicit CodeWriter(std::vector<char> &out):
+        os_ {nullptr},
+        out_(out),
+        used_ {out.size()},
+        accumulator_ {0},
+        bits_ {0}
+    {
+    }
+
+    CodeWriter(const CodeWriter &) = delete;
+    CodeWriter &operator=(const CodeWriter &) = delete;
+
+    /**
+     * Appends the `width` low bits of `k`.
+     *
+     * @param k        code to be written
+     * @param width    number of bits, at most 32
+    */
+    void write(std::uint32_t k, unsigned int width)
+    {
+        accumulator_ |= static_cast<std::uint64_t> (k) << bits_;
+        bits_ += width;
+
+        if (bits_ >= 32)
+        {
+            if (used_ + 4 > out_.size())
+                overflow();
+
+            char * const p {&out_[used_]};
+
+            for (int b = 0; b < 4; ++b)
+                p[b] = static_cast<char> (accumulator_ >> (8 * b));
+
+            used_ += 4;
+            accumulator_ >>= 32;
+            bits_ -= 32;
+        }
+    }
+
+    /// Pads the last byte with zero bits and writes everything out.
+    void finish()
+    {
+        for (; bits_ > 0; bits_ -= std::min(bits_, 8u))
+        {
+            if (used_ == out_.size())
+                overflow();
+
+            out_[used_++] = static_cast<char> (accumulator_);
+            accumulator_ >>= 8;
+        }
+
+        if (os_ != nullptr)
+        {
+            os_->write(out_.data(), used_);
+            used_ = 0;
+        }
+        else
+            out_.resize(used_);
+    }
+
+    /**
+     * Moves the bytes of the codes written so far to the end of `out`.
+     *
+     * The bits that do not fill a byte yet stay behind, so codes can keep
+     * being written afterwards.
+     *
+     * @param [out] out    buffer the bytes are appended to
+    */
+    void drain(std::vector<char> &out)
+    {
+        out.insert(out.end(), out_.data(), out_.data() + used_);
+        used_ = 0;
+    }
+
+private:
+
+    static const std::size_t chunk_size {64 * 1024};
+
+    /// Makes room for at least 4 more bytes.
+    void overflow()
+    {
+        if (os_ != nullptr)
+        {
+            os_->write(out_.data(), used_);
+            used_ = 0;
+        }
+        else
+            out_.resize(out_.empty() ? chunk_size : 2 * out_.size());
+    }
+
+    std::ostream *os_;
+    std::vector<char> chunk_;
+    std::vector<char> &out_;    ///< `chunk_`, or the vector the codes are appended to
+    std::size_t used_;          ///< number of bytes of `out_` holding codes
+    std::uint64_t accumulator_;
+    unsigned int bits_;         ///< number of pending bits in `accumulator_`
+};
+
+
+/**
+     * Unpacks codes of varying widths written by `CodeWriter`.
+     *
+     * Reads either from a stream, one chunk at a time, or straight from memory.
+*/
+class CodeReader
+{
+public:
+
+    /**
+     * @param [in] is      input stream
+     * @param pending      bytes already taken from `is` that belong to the code stream
+     * @param count        number of bytes at `pending`, at most 8
+    */
+    explicit CodeReader(std::istream &is, const char *pending = nullptr, std::size_t count = 0):
+        is_ {&is},
+        chunk_(chunk_size),
+        accumulator_ {0},
+        bits_ {0}
+    {
+        if (count != 0)
+            std::memcpy(chunk_.data(), pending, count);
+
+        next_ = chunk_.data();
+        end_ = next_ + count;
+    }
+
+    /// Reads the codes in the bytes from `first` to `last`.
+    CodeReader(const char *first, const char *last):
+        is_ {nullptr},
+        next_ {first},
+        end_ {last},
+        accumulator_ {0},
+        bits_ {0}
+    {
+    }
+
+    CodeReader(const CodeReader &) = delete;
+    CodeReader &operator=(const CodeReader &) = delete;
+
+    /**
+     * Reads the next code.
+     *
+     * @param [out] k      code read
+     * @param width        number of bits, at most 32
+     * @return             false if fewer than `width` bits were left
+    */
+    bool read(std::uint32_t &k, unsigned int width)
+    {
+        if (bits_ < width)
+        {
+            refill();
+
+            if (bits_ < width)
+                return false;
+        }
+
+        k = static_cast<std::uint32_t> (accumulator_ & ((std::uint64_t {1} << width) - 1));
+        accumulator_ >>= width;
+        bits_ -= width;
+        return true;
+    }
+
+    /**
+     * Continues a reader over memory with the bytes from `first` to `last`, once `read()` has failed
+     * for lack of bits. The bits left over from the previous bytes are kept.
+    */
+    void append(const char *first, const char *last)
+    {
+        next_ = first;
+        end_ = last;
+    }
+
+    /// Returns whether only zero padding, shorter than a byte, followed the last code read.
+    bool clean_end() const
+    {
+        return bits_ < 8 && accumulator_ == 0;
+    }
+
+private:
+
+    static const std::size_t chunk_size {64 * 1024};
+
+    void refill()
+    {
+        while (bits_ <= 56)
+        {
+            if (next_ == end_)
+            {
+                if (is_ == nullptr)
+                    return;
+
+                is_->read(chunk_.data(), chunk_.size());
+                next_ = chunk_.data();
+                end_ = next_ + is_->gcount();
+
+                if (next_ == end_)
+                    return;
+            }
+
+            accumulator_ |= static_cast<std::uint64_t> (static_cast<unsigned char> (*next_++)) << bits_;
+            bits_ += 8;
+        }
+    }
+
+    std::istream *is_;
+    std::vector<char> chunk_;
+    const char *next_;          ///< next byte to be moved to `accumulator_`
+    const char *end_;           ///< end of the bytes available at `next_`
+    std::uint64_t accumulator_;
+    unsigned int bits_;         ///< number of unread bits in `accumulator_`
+};
+
+#endif // MEGALZW_BITIO_H
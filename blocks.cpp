@@ -0,0 +1,776 @@
+#include "blocks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "bitio.h"
+#include "codec.h"
+#include "crc32c.h"
+#include "format.h"
+#include "parallel.h"
+
+
+namespace {
+
+/// Where a block is in the file, how large it is before and after compression, and its checksum.
+struct IndexEntry
+{
+    std::uint64_t offset;
+    std::uint32_t compressed_size;  ///< with `format::stored_block` set if the block is stored
+    std::uint32_t original_size;
+    std::uint32_t checksum;         ///< 0 in version 2 files
+};
+
+
+/// A block's codes, wherever they are in memory, and the size and checksum of its original data.
+struct BlockRef
+{
+    const char *data;
+    std::uint32_t compressed_size;  ///< with `format::stored_block` set if the block is stored
+    std::uint32_t original_size;
+    std::uint32_t checksum;
+};
+
+
+/// Returns the bytes a block whose compressed size field is `compressed_size` takes in the file.
+std::uint32_t size_in_file(std::uint32_t compressed_size)
+{
+    return compressed_size & ~format::stored_block;
+}
+
+
+/// Sizes of the parts of a file of blocks, which grow by a checksum each in version 3.
+struct Layout
+{
+    bool checked;                   ///< whether the blocks have checksums
+    std::size_t block_header_size;
+    std::size_t index_entry_size;
+    std::size_t trailer_size;
+
+    explicit Layout(unsigned int version):
+        checked {version == format::version_checked_blocks},
+        block_header_size {format::block_header_size + (checked ? format::checksum_size : 0)},
+        index_entry_size {format::index_entry_size + (checked ? format::checksum_size : 0)},
+        trailer_size {format::trailer_size + (checked ? format::checksum_size : 0)}
+    {
+    }
+};
+
+
+/// Largest of the sizes of `Layout`.
+const std::size_t max_field_size {format::index_entry_size + format::checksum_size};
+
+
+/// Upper bound on the compressed size of a block: codes are never more than 3 bytes per input byte.
+std::size_t max_compressed_size(std::size_t original_size)
+{
+    return 3 * original_size + 8;
+}
+
+
+/// Order-0 entropy, in bits per byte, from which a block is first compressed on a sample of it.
+const double high_entropy {7.5};
+
+/// Bytes at the start of a block of high entropy compressed to tell whether the rest is worth it.
+const std::size_t entropy_sample_size {64 * 1024};
+
+
+/// Returns the order-0 entropy of the `size` bytes at `data`, in bits per byte.
+double byte_entropy(const char *data, std::size_t size)
+{
+    // four histograms, so that runs of the same byte do not wait on the same counter
+    std::uint32_t counts[4][256] {};
+    std::size_t n {0};
+
+    for (; n + 4 <= size; n += 4)
+    {
+        ++counts[0][static_cast<unsigned char> (data[n])];
+        ++counts[1][static_cast<unsigned char> (data[n + 1])];
+        ++counts[2][static_cast<unsigned char> (data[n + 2])];
+        ++counts[3][static_cast<unsigned char> (data[n + 3])];
+    }
+
+    for (; n < size; ++n)
+        ++counts[0][static_cast<unsigned char> (data[n])];
+
+    double entropy {0};
+
+    for (unsigned int c = 0; c < 256; ++c)
+    {
+        const std::uint32_t count {counts[0][c] + counts[1][c] + counts[2][c] + counts[3][c]};
+
+        if (count != 0)
+            entropy -= count * std::log2(static_cast<double> (count) / size);
+    }
+
+    return size == 0 ? 0 : entropy / size;
+}
+
+
+/**
+     * Returns whether the block `input` is not worth compressing, without
+     * compressing all of it.
+     *
+     * LZW makes data of high order-0 entropy larger, but repeated strings of
+     * such bytes still compress; so a block of high entropy is only given up
+     * once a sample from its start does not compress either.
+     *
+     * @param input        the block
+     * @param options      code width, dictionary engine and reset policy
+     * @param [out] codes  buffer for the codes of the sample
+*/
+bool incompressible(const MemoryInput &input, const Options &options, std::vector<char> &codes)
+{
+    const std::size_t size {static_cast<std::size_t> (input.last - input.first)};
+
+    if (byte_entropy(input.first, size) < high_entropy)
+        return false;
+
+    MemoryInput sample {input.first, input.first + std::min(size, entropy_sample_size)};
+    CodeWriter writer(codes);
+
+    compress_codes(sample, writer, options);
+    writer.finish();
+
+    return codes.size() >= static_cast<std::size_t> (sample.last - input.first);
+}
+
+
+/**
+     * Writes the blocks of a version 2 or 3 file and their index.
+     *
+     * Blocks are taken a batch at a time from `next_batch`, compressed and
+     * checksummed in parallel, and written in order. Those whose codes are
+     * not smaller than their data, or that `incompressible()` gives up on,
+     * are stored instead.
+     *
+     * @param [out] os         `std::ostream` or `VectorOutput`, positioned right after the common header
+     * @param options          code width, dictionary engine, block size, threads and checksums
+     * @param batch_size       maximum number of blocks in a batch
+     * @param next_batch       function object filling a `std::vector<MemoryInput>` of
+     *                         `batch_size` elements with the next blocks, and returning
+     *                         how many it filled; fewer than `batch_size` means the
+     *                         input is done
+     * @return                 work done
+*/
+template <typename Sink, typename Source>
+CodeCounts write_blocks(Sink &os, const Options &options, std::size_t batch_size, Source next_batch)
+{
+    const Layout layout(options.checksums ? format::version_checked_blocks : format::version_blocks);
+    char field[max_field_size] {};
+
+    format::put_u32(field, static_cast<std::uint32_t> (options.block_size));
+    os.write(field, 4);
+
+    std::uint64_t offset {format::header_size + 4};
+    std::vector<IndexEntry> index;
+
+    std::vector<MemoryInput> original(batch_size);
+    std::vector<std::vector<char>> compressed(batch_size);
+    std::vector<CodeCounts> counts(batch_size);
+    std::vector<std::uint32_t> checksums(batch_size);
+    std::vector<char> stored(batch_size);     // not `std::vector<bool>`, whose elements threads cannot write apart
+    CodeCounts total {0, 0};
+    std::uint32_t checksum {0};
+
+    for (std::size_t count = batch_size; count == batch_size; )
+    {
+        count = next_batch(original);
+
+        parallel_for(count, options.threads, [&](std::size_t b) {
+            MemoryInput input {original[b]};
+            const std::size_t size {static_cast<std::size_t> (original[b].last - original[b].first)};
+
+            compressed[b].clear();
+            counts[b] = CodeCounts {0, 0};
+            stored[b] = incompressible(input, options, compressed[b]);
+
+            if (!stored[b])
+            {
+                compressed[b].clear();
+
+                CodeWriter writer(compressed[b]);
+
+                counts[b] = compress_codes(input, writer, options);
+                writer.finish();
+
+                stored[b] = compressed[b].size() >= size;
+            }
+
+            if (layout.checked)
+                checksums[b] = crc32c(original[b].first, size);
+        });
+
+        for (std::size_t b = 0; b < count; ++b)
+        {
+            const std::uint32_t original_size {static_cast<std::uint32_t> (original[b].last - original[b].first)};
+            const IndexEntry entry {
+                offset,
+                stored[b] ? original_size | format::stored_block : static_cast<std::uint32_t> (compressed[b].size()),
+                original_size,
+                layout.checked ? checksums[b] : 0
+            };
+
+            format::put_u32(field, entry.original_size);
+            format::put_u32(field + 4, entry.compressed_size);
+            format::put_u32(field + 8, entry.checksum);
+            os.write(field, layout.block_header_size);
+
+            if (stored[b])
+                os.write(original[b].first, original_size);
+            else
+                os.write(compressed[b].data(), compressed[b].size());
+
+            index.push_back(entry);
+            offset += layout.block_header_size + size_in_file(entry.compressed_size);
+            total.add(counts[b]);
+
+            if (layout.checked)
+                checksum = crc32c_combine(checksum, entry.checksum, entry.original_size);
+        }
+    }
+
+    // the end of the blocks reads as an empty block
+    std::memset(field, 0, sizeof field);
+    os.write(field, layout.block_header_size);
+
+    const std::uint64_t index_offset {offset + layout.block_header_size};
+    std::vector<char> table(8 + index.size() * layout.index_entry_size + layout.trailer_size);
+    char *p {table.data()};
+
+    format::put_u64(p, index.size());
+    p += 8;
+
+    for (const IndexEntry &entry : index)
+    {
+        format::put_u64(p, entry.offset);
+        format::put_u32(p + 8, entry.compressed_size);
+        format::put_u32(p + 12, entry.original_size);
+
+        if (layout.checked)
+            format::put_u32(p + 16, entry.checksum);
+
+        p += layout.index_entry_size;
+    }
+
+    if (layout.checked)
+    {
+        format::put_u32(p, checksum);
+        p += format::checksum_size;
+    }
+
+    format::put_u64(p, index_offset);
+    std::memcpy(p + 8, format::index_magic, sizeof format::index_magic);
+    os.write(table.data(), table.size());
+    return total;
+}
+
+
+/// Compresses the blocks of the `size` bytes at `data` where they are, and writes them to `os`.
+template <typename Sink>
+CodeCounts compress_memory_blocks(const char *data, std::size_t size, Sink &os, const Options &options)
+{
+    if (options.block_size == 0 || options.block_size > max_block_size)
+        throw std::invalid_argument("unsupported block size");
+
+    const std::size_t batch_size {2 * thread_count(options.threads)};
+    const char * const last {data + size};
+
+    return write_blocks(os, options, batch_size, [&](std::vector<MemoryInput> &blocks) -> std::size_t {
+        std::size_t count {0};
+
+        for (; count < batch_size && data != last; ++count)
+        {
+            const std::size_t n {std::min<std::size_t> (options.block_size, last - data)};
+
+            blocks[count] = MemoryInput {data, data + n};
+            data += n;
+        }
+
+        return count;
+    });
+}
+
+
+/**
+     * Decodes one block into the `original_size` bytes at `out`.
+     *
+     * @param block        the block's codes, original size and checksum
+     * @param [out] out    destination of the original data
+     * @param code_format  how the codes were written
+     * @param checked      whether to check the data decoded against the block's checksum
+     * @return             work done
+*/
+CodeCounts decode_block(const BlockRef &block, char *out, const CodeFormat &code_format, bool checked)
+{
+    CodeCounts counts {0, 0};
+
+    if ((block.compressed_size & format::stored_block) != 0)
+    {
+        if (size_in_file(block.compressed_size) != block.original_size)
+            throw std::runtime_error("corrupted compressed file");
+
+        std::memcpy(out, block.data, block.original_size);
+    }
+    else
+    {
+        CodeReader reader(block.data, block.data + block.compressed_size);
+        SpanOutput output {out, out + block.original_size};
+
+        counts = decompress_codes(reader, output, code_format);
+
+        if (output.first != output.last)
+            throw std::runtime_error("corrupted compressed file");
+    }
+
+    // while the block is still in the cache
+    if (checked && crc32c(out, block.original_size) != block.checksum)
+        throw std::runtime_error("checksum mismatch");
+
+    return counts;
+}
+
+
+/**
+     * Decodes `count` blocks in parallel, into consecutive places of `out`.
+     *
+     * @param blocks       the blocks
+     * @param count        number of blocks to decode from the start of `blocks`
+     * @param [out] out    destination of the original data, sized for all the blocks
+     * @param code_format  how the codes were written
+     * @param checked      whether to check the data decoded against the blocks' checksums
+     * @param threads      maximum number of threads, 0 for one per hardware thread
+     * @return             work done
+*/
+CodeCounts decode_blocks(const std::vector<BlockRef> &blocks, std::size_t count, char *out,
+                         const CodeFormat &code_format, bool checked, unsigned int threads)
+{
+    std::vector<char *> places(count);
+    std::vector<CodeCounts> counts(count);
+
+    for (std::size_t b = 0; b < count; ++b)
+    {
+        places[b] = out;
+        out += blocks[b].original_size;
+    }
+
+    parallel_for(count, threads, [&](std::size_t b) {
+        counts[b] = decode_block(blocks[b], places[b], code_format, checked);
+    });
+
+    CodeCounts total {0, 0};
+
+    for (const CodeCounts &c : counts)
+        total.add(c);
+
+    return total;
+}
+
+
+/**
+     * Decodes the block index of a version 2 or 3 file.
+     *
+     * In version 3, the checksums of the blocks are checked against that of
+     * all of them in the trailer, so that those of the index can be trusted.
+     * The output is sized from the index, so no entry may hold more than a
+     * block of the file can.
+     *
+     * @param table            the index, after its block count
+     * @param count            number of blocks
+     * @param index_offset     position of the index in the file
+     * @param trailer          the trailer
+     * @param block_size       block size in the header of the file
+     * @param layout           sizes of the parts of the file
+     * @return                 one entry per block
+*/
+std::vector<IndexEntry> parse_index(const char *table, std::size_t count, std::uint64_t index_offset,
+                                    const char *trailer, std::uint32_t block_size, const Layout &layout)
+{
+    if (block_size == 0 || block_size > max_block_size)
+        throw std::runtime_error("corrupted compressed file");
+
+    std::vector<IndexEntry> index(count);
+    std::uint32_t checksum {0};
+
+    for (std::size_t b = 0; b < count; ++b)
+    {
+        const char * const p {table + b * layout.index_entry_size};
+
+        index[b] = IndexEntry {
+            format::get_u64(p), format::get_u32(p + 8), format::get_u32(p + 12),
+            layout.checked ? format::get_u32(p + 16) : 0
+        };
+
+        // no sum is taken, which a forged offset could wrap around
+        if (index[b].offset > index_offset
+            || layout.block_header_size + size_in_file(index[b].compressed_size) > index_offset - index[b].offset)
+            throw std::runtime_error("corrupted block index");
+
+        if (index[b].original_size > block_size
+            || size_in_file(index[b].compressed_size) > max_compressed_size(block_size))
+            throw std::runtime_error("corrupted block index");
+
+        if (layout.checked)
+            checksum = crc32c_combine(checksum, index[b].checksum, index[b].original_size);
+    }
+
+    if (layout.checked && checksum != format::get_u32(trailer))
+        throw std::runtime_error("checksum mismatch");
+
+    return index;
+}
+
+
+/**
+     * Reads the block index of a version 2 or 3 file.
+     *
+     * @param [in] is      seekable input stream
+     * @param layout       sizes of the parts of the file
+     * @return             one entry per block
+*/
+std::vector<IndexEntry> read_index(std::istream &is, const Layout &layout)
+{
+    char trailer[format::trailer_size + format::checksum_size];
+    const std::size_t magic_offset {layout.trailer_size - sizeof format::index_magic};
+
+    is.seekg(-static_cast<std::streamoff> (layout.trailer_size), std::ios_base::end);
+    const std::uint64_t index_end {static_cast<std::uint64_t> (is.tellg())};
+
+    if (!is.read(trailer, layout.trailer_size)
+        || std::memcmp(trailer + magic_offset, format::index_magic, sizeof format::index_magic) != 0)
+        throw std::runtime_error("missing block index");
+
+    const std::uint64_t index_offset {format::get_u64(trailer + magic_offset - 8)};
+    char field[8];
+
+    is.seekg(static_cast<std::streamoff> (format::header_size));
+
+    if (!is.read(field, 4))
+        throw std::runtime_error("corrupted compressed file");
+
+    const std::uint32_t block_size {format::get_u32(field)};
+
+    is.seekg(static_cast<std::streamoff> (index_offset));
+
+    if (index_offset > index_end || index_end - index_offset < sizeof field || !is.read(field, sizeof field))
+        throw std::runtime_error("corrupted block index");
+
+    const std::uint64_t count {format::get_u64(field)};
+
+    if (count != (index_end - index_offset - sizeof field) / layout.index_entry_size)
+        throw std::runtime_error("corrupted block index");
+
+    std::vector<char> table(static_cast<std::size_t> (count) * layout.index_entry_size);
+
+    if (!is.read(table.data(), table.size()))
+        throw std::runtime_error("corrupted block index");
+
+    return parse_index(table.data(), table.size() / layout.index_entry_size, index_offset, trailer, block_size,
+                       layout);
+}
+
+
+/**
+     * Finds the block index of a version 2 or 3 file in memory.
+     *
+     * @param data     the whole file
+     * @param size     size of the file
+     * @param layout   sizes of the parts of the file
+     * @return         one entry per block
+*/
+std::vector<IndexEntry> read_index(const char *data, std::size_t size, const Layout &layout)
+{
+    if (size < format::header_size + 4 + layout.trailer_size
+        || std::memcmp(data + size - 4, format::index_magic, sizeof format::index_magic) != 0)
+        throw std::runtime_error("missing block index");
+
+    const std::size_t index_end {size - layout.trailer_size};
+    const std::uint64_t index_offset {format::get_u64(data + size - 12)};
+
+    if (index_offset > index_end || index_end - index_offset < 8)
+        throw std::runtime_error("corrupted block index");
+
+    const std::uint64_t count {format::get_u64(data + index_offset)};
+
+    if (count != (index_end - index_offset - 8) / layout.index_entry_size)
+        throw std::runtime_error("corrupted block index");
+
+    return parse_index(data + index_offset + 8, static_cast<std::size_t> (count), index_offset, data + index_end,
+                       format::get_u32(data + format::header_size), layout);
+}
+
+
+/// Returns the blocks of `index` in the file at `data`, checking them against their headers.
+std::vector<BlockRef> block_refs(const char *data, const std::vector<IndexEntry> &index, const Layout &layout)
+{
+    std::vector<BlockRef> blocks;
+
+    for (const IndexEntry &entry : index)
+    {
+        const char * const header {data + entry.offset};
+
+        if (format::get_u32(header) != entry.original_size || format::get_u32(header + 4) != entry.compressed_size
+            || (layout.checked && format::get_u32(header + 8) != entry.checksum))
+            throw std::runtime_error("corrupted block index");
+
+        blocks.push_back(BlockRef {header + layout.block_header_size, entry.compressed_size, entry.original_size,
+                                   entry.checksum});
+    }
+
+    return blocks;
+}
+
+} // namespace
+
+
+CodeCounts compress_blocks(std::istream &is, std::ostream &os, const Options &options)
+{
+    if (options.block_size == 0 || options.block_size > max_block_size)
+        throw std::invalid_argument("unsupported block size");
+
+    // two blocks per thread are in memory at a time
+    const std::size_t batch_size {2 * thread_count(options.threads)};
+    std::vector<std::vector<char>> original(batch_size);
+
+    return write_blocks(os, options, batch_size, [&](std::vector<MemoryInput> &blocks) -> std::size_t {
+        std::size_t count {0};
+
+        while (count < batch_size && is)
+        {
+            std::vector<char> &block = original[count];
+
+            block.resize(options.block_size);
+            is.read(block.data(), options.block_size);
+            block.resize(static_cast<std::size_t> (is.gcount()));
+
+            if (!block.empty())
+                blocks[count++] = MemoryInput {block.data(), block.data() + block.size()};
+        }
+
+        return count;
+    });
+}
+
+
+CodeCounts compress_blocks(const char *data, std::size_t size, std::ostream &os, const Options &options)
+{
+    return compress_memory_blocks(data, size, os, options);
+}
+
+
+CodeCounts compress_blocks(const char *data, std::size_t size, std::vector<char> &out, const Options &options)
+{
+    VectorOutput output {out};
+
+    return compress_memory_blocks(data, size, output, options);
+}
+
+
+CodeCounts decompress_blocks(std::istream &is, std::ostream &os, const CodeFormat &code_format,
+                             unsigned int version, unsigned int threads)
+{
+    const Layout layout(version);
+    char field[max_field_size];
+
+    if (!is.read(field, 4))
+        throw std::runtime_error("corrupted compressed file");
+
+    const std::uint32_t block_size {format::get_u32(field)};
+
+    if (block_size == 0 || block_size > max_block_size)
+        throw std::runtime_error("corrupted compressed file");
+
+    // two blocks per thread are in memory at a time
+    const std::size_t batch_size {2 * thread_count(threads)};
+    std::vector<std::vector<char>> compressed(batch_size);
+    std::vector<BlockRef> blocks(batch_size);
+    std::vector<char> original;
+    CodeCounts counts {0, 0};
+    std::uint32_t checksum {0};
+
+    for (bool more = true; more; )
+    {
+        std::size_t count {0};
+        std::size_t total {0};
+
+        for (; count < batch_size; ++count)
+        {
+            if (!is.read(field, layout.block_header_size))
+                throw std::runtime_error("corrupted compressed file");
+
+            const std::uint32_t original_size {format::get_u32(field)};
+            const std::uint32_t compressed_size {format::get_u32(field + 4)};
+            const std::uint32_t block_checksum {layout.checked ? format::get_u32(field + 8) : 0};
+
+            if (original_size == 0 && compressed_size == 0)
+            {
+                more = false;
+                break;
+            }
+
+            if (original_size > block_size || size_in_file(compressed_size) > max_compressed_size(block_size))
+                throw std::runtime_error("corrupted compressed file");
+
+            compressed[count].resize(size_in_file(compressed_size));
+
+            if (!is.read(compressed[count].data(), size_in_file(compressed_size)))
+                throw std::runtime_error("corrupted compressed file");
+
+            blocks[count] = BlockRef {compressed[count].data(), compressed_size, original_size, block_checksum};
+            total += original_size;
+
+            if (layout.checked)
+                checksum = crc32c_combine(checksum, block_checksum, original_size);
+        }
+
+        original.resize(total);
+        counts.add(decode_blocks(blocks, count, original.data(), code_format, layout.checked, threads));
+        os.write(original.data(), original.size());
+    }
+
+    if (layout.checked)
+    {
+        // the index is skipped to check the checksum of all the blocks in the trailer
+        if (!is.read(field, 8))
+            throw std::runtime_error("missing block index");
+
+        const std::uint64_t count {format::get_u64(field)};
+
+        for (std::uint64_t b = 0; b < count; ++b)
+            if (!is.read(field, layout.index_entry_size))
+                throw std::runtime_error("missing block index");
+
+        if (!is.read(field, layout.trailer_size)
+            || std::memcmp(field + layout.trailer_size - 4, format::index_magic, sizeof format::index_magic) != 0)
+            throw std::runtime_error("missing block index");
+
+        if (format::get_u32(field) != checksum)
+            throw std::runtime_error("checksum mismatch");
+    }
+
+    return counts;
+}
+
+
+CodeCounts decompress_block_range(std::istream &is, std::ostream &os, const CodeFormat &code_format,
+                                  unsigned int version, std::uint64_t offset, std::uint64_t length,
+                                  unsigned int threads)
+{
+    const Layout layout(version);
+    const std::vector<IndexEntry> index {read_index(is, layout)};
+
+    // the blocks from `first` up to `last` cover the range, and `start` is where `first` begins
+    std::size_t first {0};
+    std::uint64_t start {0};
+
+    for (; first < index.size() && start + index[first].original_size <= offset; ++first)
+        start += index[first].original_size;
+
+    std::size_t last {first};
+
+    for (std::uint64_t end = start; last < index.size() && end < offset + length; ++last)
+        end += index[last].original_size;
+
+    const std::size_t batch_size {2 * thread_count(threads)};
+    std::vector<std::vector<char>> compressed(batch_size);
+    std::vector<BlockRef> blocks(batch_size);
+    std::vector<char> original;
+    CodeCounts counts {0, 0};
+    WindowOutput output {os, offset - std::min(offset, start), length};
+
+    for (std::size_t batch = first; batch < last; batch += batch_size)
+    {
+        const std::size_t count {std::min(batch_size, last - batch)};
+        std::size_t total {0};
+
+        for (std::size_t b = 0; b < count; ++b)
+        {
+            const IndexEntry &entry = index[batch + b];
+            char header[max_field_size];
+
+            is.seekg(static_cast<std::streamoff> (entry.offset));
+
+            if (!is.read(header, layout.block_header_size))
+                throw std::runtime_error("corrupted compressed file");
+
+            if (format::get_u32(header) != entry.original_size || format::get_u32(header + 4) != entry.compressed_size
+                || (layout.checked && format::get_u32(header + 8) != entry.checksum))
+                throw std::runtime_error("corrupted block index");
+
+            compressed[b].resize(size_in_file(entry.compressed_size));
+
+            if (!is.read(compressed[b].data(), size_in_file(entry.compressed_size)))
+                throw std::runtime_error("corrupted compressed file");
+
+            blocks[b] = BlockRef {compressed[b].data(), entry.compressed_size, entry.original_size, entry.checksum};
+            total += entry.original_size;
+        }
+
+        original.resize(total);
+        counts.add(decode_blocks(blocks, count, original.data(), code_format, layout.checked, threads));
+        output.write(original.data(), original.size());
+    }
+
+    return counts;
+}
+
+
+std::uint64_t blocks_original_size(const char *data, std::size_t size)
+{
+    std::uint64_t total {0};
+
+    for (const IndexEntry &entry : read_index(data, size, Layout(static_cast<std::uint8_t> (data[4]))))
+        total += entry.original_size;
+
+    return total;
+}
+
+
+CodeCounts decompress_blocks(const char *data, std::size_t size, char *out, std::size_t out_size,
+                             const CodeFormat &code_format, unsigned int threads)
+{
+    const Layout layout(static_cast<std::uint8_t> (data[4]));
+    const std::vector<BlockRef> blocks {block_refs(data, read_index(data, size, layout), layout)};
+    std::uint64_t total {0};
+
+    for (const BlockRef &block : blocks)
+        total += block.original_size;
+
+    if (total != out_size)
+        throw std::runtime_error("output size does not match the original size");
+
+    return decode_blocks(blocks, blocks.size(), out, code_format, layout.checked, threads);
+}
+
+
+CodeCounts decompress_blocks(const char *data, std::size_t size, std::ostream &os, const CodeFormat &code_format,
+                             unsigned int threads)
+{
+    const Layout layout(static_cast<std::uint8_t> (data[4]));
+    const std::vector<BlockRef> all {block_refs(data, read_index(data, size, layout), layout)};
+    const std::size_t batch_size {2 * thread_count(threads)};
+    std::vector<BlockRef> blocks(batch_size);
+    std::vector<char> original;
+    CodeCounts counts {0, 0};
+
+    for (std::size_t batch = 0; batch < all.size(); batch += batch_size)
+    {
+        const std::size_t count {std::min(batch_size, all.size() - batch)};
+        std::size_t total {0};
+
+        for (std::size_t b = 0; b < count; ++b)
+        {
+            blocks[b] = all[batch + b];
+            total += blocks[b].original_size;
+        }
+
+        original.resize(total);
+        counts.add(decode_blocks(blocks, count, original.data(), code_format, layout.checked, threads));
+        os.write(original.data(), original.size());
+    }
+
+    return counts;
+}
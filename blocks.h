@@ -0,0 +1,130 @@
+#ifndef MEGALZW_BLOCKS_H
+#define MEGALZW_BLOCKS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "codec.h"
+#include "lzw.h"
+
+
+/**
+     * Compresses the contents of `is` into the blocks of a version 2 file,
+     * or of a version 3 one if `options` asks for checksums.
+     *
+     * Writes everything that follows the common header to `os`. Blocks are
+     * read and written in order, a batch at a time, and the blocks of a
+     * batch are compressed in parallel. Blocks whose codes would not be
+     * smaller than their data are stored as they are, so that the output is
+     * at most a few bytes per block larger than the input.
+     *
+     * @param [in] is      input stream
+     * @param [out] os     output stream, positioned right after the common header
+     * @param options      code width, dictionary engine, block size, threads and checksums
+     * @return             work done
+*/
+CodeCounts compress_blocks(std::istream &is, std::ostream &os, const Options &options);
+
+/**
+     * Compresses the `size` bytes at `data` into the blocks of a version 2 or 3 file.
+     *
+     * Like the stream overload, but blocks are compressed where they are,
+     * without being copied.
+     *
+     * @param data         original data
+     * @param size         number of bytes at `data`
+     * @param [out] os     output stream, positioned right after the common header
+     * @param options      code width, dictionary engine, block size, threads and checksums
+     * @return             work done
+*/
+CodeCounts compress_blocks(const char *data, std::size_t size, std::ostream &os, const Options &options);
+
+/// Like the overload above, but appends the blocks to `out` instead of writing them to a stream.
+CodeCounts compress_blocks(const char *data, std::size_t size, std::vector<char> &out, const Options &options);
+
+/**
+     * Decompresses the blocks of a version 2 or 3 file.
+     *
+     * Reads the file front to back, so `is` need not be seekable. Blocks are
+     * read a batch at a time and the blocks of a batch are decoded in
+     * parallel, each straight into its place in the output.
+     *
+     * The blocks of a version 3 file are checked against their checksums as
+     * they are decoded, and all of them against the trailer at the end.
+     *
+     * @param [in] is      input stream, positioned right after the common header
+     * @param [out] os     output stream
+     * @param code_format  how the codes were written, as recorded in the header
+     * @param version      version of the file, 2 or 3
+     * @param threads      maximum number of threads, 0 for one per hardware thread
+     * @return             work done
+     * @throw std::runtime_error if the file is corrupted or a checksum does not match
+*/
+CodeCounts decompress_blocks(std::istream &is, std::ostream &os, const CodeFormat &code_format,
+                             unsigned int version, unsigned int threads);
+
+/**
+     * Decompresses part of the original data of a version 2 or 3 file.
+     *
+     * Looks up the blocks covering the range in the block index, and decodes
+     * only those, checking the checksums of those of a version 3 file.
+     *
+     * @param [in] is      seekable input stream
+     * @param [out] os     output stream
+     * @param code_format  how the codes were written, as recorded in the header
+     * @param version      version of the file, 2 or 3
+     * @param offset       position of the first byte wanted in the original data
+     * @param length       number of bytes wanted
+     * @param threads      maximum number of threads, 0 for one per hardware thread
+     * @return             work done
+*/
+CodeCounts decompress_block_range(std::istream &is, std::ostream &os, const CodeFormat &code_format,
+                                  unsigned int version, std::uint64_t offset, std::uint64_t length,
+                                  unsigned int threads);
+
+/**
+     * Returns the size of the original data of a version 2 or 3 file in memory,
+     * as recorded in its block index.
+     *
+     * @param data     the whole file
+     * @param size     size of the file
+*/
+std::uint64_t blocks_original_size(const char *data, std::size_t size);
+
+/**
+     * Decompresses a version 2 or 3 file in memory into memory.
+     *
+     * All the blocks are decoded in parallel, each straight into its place in
+     * `out`, and those of a version 3 file checked against their checksums.
+     *
+     * @param data         the whole file
+     * @param size         size of the file
+     * @param [out] out    destination of the original data
+     * @param out_size     size of `out`, which must be that of the original data
+     * @param code_format  how the codes were written, as recorded in the header
+     * @param threads      maximum number of threads, 0 for one per hardware thread
+     * @return             work done
+*/
+CodeCounts decompress_blocks(const char *data, std::size_t size, char *out, std::size_t out_size,
+                             const CodeFormat &code_format, unsigned int threads);
+
+/**
+     * Decompresses a version 2 or 3 file in memory.
+     *
+     * Blocks are decoded a batch at a time, in parallel, checked against
+     * their checksums in a version 3 file, and written in order.
+     *
+     * @param data         the whole file
+     * @param size         size of the file
+     * @param [out] os     output stream
+     * @param code_format  how the codes were written, as recorded in the header
+     * @param threads      maximum number of threads, 0 for one per hardware thread
+     * @return             work done
+*/
+CodeCounts decompress_blocks(const char *data, std::size_t size, std::ostream &os, const CodeFormat &code_format,
+                             unsigned int threads);
+
+#endif // MEGALZW_BLOCKS_H
@@ -0,0 +1,263 @@
+#include "bmp_filter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <vector>
+
+
+namespace {
+
+/// Where the pixels of a BMP file are.
+struct Layout
+{
+    std::size_t offset;     ///< offset of the first row
+    std::size_t rows;
+    std::size_t row_size;   ///< bytes per row, padding included
+    std::size_t width;      ///< pixels per row
+    std::size_t channels;   ///< bytes per pixel
+};
+
+
+/// Offset of the first reserved byte of the file header, where the transform is recorded.
+const std::size_t filter_offset {6};
+
+/// Rows of about this many bytes are tried by `choose_bmp_filter()`.
+const std::size_t sample_size {256 * 1024};
+
+
+/// Ways of predicting a row.
+enum class Predictor {
+    Sub,    ///< each byte from the same channel of the pixel to its left
+    Up      ///< each byte from the same byte of the row above
+};
+
+
+/// Returns the `n`-byte little-endian integer at `p`.
+std::uint32_t get_le(const char *p, int n)
+{
+    std::uint32_t v {0};
+
+    for (int b = n - 1; b >= 0; --b)
+        v = v << 8 | static_cast<unsigned char> (p[b]);
+
+    return v;
+}
+
+
+/// Finds the pixels of the BMP file at `data`; returns false if it is not one that can be transformed.
+bool parse_layout(const char *data, std::size_t size, Layout &layout)
+{
+    // file header and BITMAPINFOHEADER
+    if (size < 54 || data[0] != 'B' || data[1] != 'M')
+        return false;
+
+    const std::uint32_t offset {get_le(data + 10, 4)};
+    const std::uint32_t info_size {get_le(data + 14, 4)};
+    const std::int32_t width {static_cast<std::int32_t> (get_le(data + 18, 4))};
+    const std::int32_t height {static_cast<std::int32_t> (get_le(data + 22, 4))};
+    const std::uint32_t planes {get_le(data + 26, 2)};
+    const std::uint32_t bits {get_le(data + 28, 2)};
+    const std::uint32_t compression {get_le(data + 30, 4)};
+
+    // uncompressed, or 32-bit with channel masks, which do not move the bytes
+    if (info_size < 40 || planes != 1 || (bits != 24 && bits != 32) || (compression != 0 && !(compression == 3 && bits == 32)))
+        return false;
+
+    if (width <= 0 || height == 0 || height == INT32_MIN || offset < 14 + info_size || offset > size)
+        return false;
+
+    layout.offset = offset;
+    layout.rows = static_cast<std::size_t> (height < 0 ? -height : height);
+    layout.width = static_cast<std::size_t> (width);
+    layout.channels = bits / 8;
+
+    if (layout.width > (size - offset) / layout.channels)
+        return false;
+
+    layout.row_size = (layout.width * layout.channels + 3) / 4 * 4;
+    return layout.rows <= (size - offset) / layout.row_size;
+}
+
+
+/// Returns the magnitude of the difference `d`, taken as a signed byte.
+unsigned int magnitude(unsigned char d)
+{
+    return d < 128 ? d : 256u - d;
+}
+
+
+/**
+     * Returns the predictor for the row after `row`, the one that predicts
+     * `row` itself best.
+     *
+     * @param row      previous row, or null for the first row
+     * @param above    row before `row`, or null
+     * @param layout   where the pixels are
+*/
+Predictor choose(const unsigned char *row, const unsigned char *above, const Layout &layout)
+{
+    if (row == nullptr)
+        return Predictor::Sub;
+
+    const std::size_t length {layout.width * layout.channels};
+    std::uint64_t sub {0};
+    std::uint64_t up {0};
+
+    for (std::size_t b = 0; b < length; ++b)
+    {
+        sub += magnitude(static_cast<unsigned char> (row[b] - (b >= layout.channels ? row[b - layout.channels] : 0)));
+        up += magnitude(static_cast<unsigned char> (row[b] - (above != nullptr ? above[b] : 0)));
+    }
+
+    return up <= sub ? Predictor::Up : Predictor::Sub;
+}
+
+
+/// Returns the first byte of row `y` of the image at `data`.
+const unsigned char *row_at(const char *data, const Layout &layout, std::size_t y)
+{
+    return reinterpret_cast<const unsigned char *> (data + layout.offset + y * layout.row_size);
+}
+
+
+/**
+     * Transforms rows `first` to `last` of the image at `data`.
+     *
+     * @param data         BMP file
+     * @param layout       where its pixels are
+     * @param filter       transform
+     * @param first        first row
+     * @param last         one past the last row
+     * @param [out] out    receives the transformed rows, starting with row `first`
+*/
+void filter_rows(const char *data, const Layout &layout, BmpFilter filter, std::size_t first, std::size_t last,
+                 char *out)
+{
+    const std::size_t channels {layout.channels};
+    const std::size_t width {layout.width};
+    const std::size_t length {width * channels};
+    const bool adaptive {filter == BmpFilter::Adaptive || filter == BmpFilter::AdaptivePlanes};
+    const bool planes {filter == BmpFilter::UpPlanes || filter == BmpFilter::AdaptivePlanes};
+
+    for (std::size_t y = first; y < last; ++y)
+    {
+        const unsigned char * const row {row_at(data, layout, y)};
+        const unsigned char * const above {y > 0 ? row_at(data, layout, y - 1) : nullptr};
+        const unsigned char * const before_above {y > 1 ? row_at(data, layout, y - 2) : nullptr};
+        const Predictor predictor {adaptive ? choose(above, before_above, layout) : Predictor::Up};
+        unsigned char * const target {reinterpret_cast<unsigned char *> (out + (y - first) * layout.row_size)};
+
+        for (std::size_t x = 0; x < width; ++x)
+            for (std::size_t c = 0; c < channels; ++c)
+            {
+                const std::size_t b {x * channels + c};
+                const unsigned char prediction = predictor == Predictor::Sub ? (x > 0 ? row[b - channels] : 0)
+                                                                             : (above != nullptr ? above[b] : 0);
+
+                target[planes ? c * width + x : b] = static_cast<unsigned char> (row[b] - prediction);
+            }
+
+        std::memcpy(target + length, row + length, layout.row_size - length);
+    }
+}
+
+} // namespace
+
+
+bool filterable_bmp(const char *data, std::size_t size)
+{
+    Layout layout;
+
+    return parse_layout(data, size, layout) && data[filter_offset] == 0;
+}
+
+
+BmpFilter choose_bmp_filter(const char *data, std::size_t size,
+                            const std::function<std::size_t (const char *, std::size_t)> &compressed_size)
+{
+    Layout layout;
+
+    if (!parse_layout(data, size, layout))
+        throw std::invalid_argument("not a BMP image that can be filtered");
+
+    const std::size_t rows {std::min(layout.rows, std::max<std::size_t> (1, sample_size / layout.row_size))};
+    const std::size_t first {(layout.rows - rows) / 2};
+    std::vector<char> sample(rows * layout.row_size);
+    BmpFilter best {BmpFilter::None};
+    std::size_t best_size {compressed_size(data + layout.offset + first * layout.row_size, sample.size())};
+
+    for (const BmpFilter filter: {BmpFilter::Up, BmpFilter::UpPlanes, BmpFilter::Adaptive, BmpFilter::AdaptivePlanes})
+    {
+        filter_rows(data, layout, filter, first, first + rows, sample.data());
+
+        const std::size_t filtered_size {compressed_size(sample.data(), sample.size())};
+
+        if (filtered_size < best_size)
+        {
+            best = filter;
+            best_size = filtered_size;
+        }
+    }
+
+    return best;
+}
+
+
+void bmp_filter(const char *data, std::size_t size, BmpFilter filter, char *out)
+{
+    Layout layout;
+
+    if (!parse_layout(data, size, layout) || filter == BmpFilter::None)
+        throw std::invalid_argument("not a BMP image that can be filtered");
+
+    std::memcpy(out, data, size);
+    out[filter_offset] = static_cast<char> (filter);
+    filter_rows(data, layout, filter, 0, layout.rows, out + layout.offset);
+}
+
+
+void bmp_unfilter(char *data, std::size_t size)
+{
+    Layout layout;
+
+    if (!parse_layout(data, size, layout))
+        throw std::runtime_error("corrupted compressed file");
+
+    const BmpFilter filter {static_cast<BmpFilter> (static_cast<unsigned char> (data[filter_offset]))};
+
+    if (filter != BmpFilter::Up && filter != BmpFilter::UpPlanes && filter != BmpFilter::Adaptive &&
+        filter != BmpFilter::AdaptivePlanes)
+        throw std::runtime_error("corrupted compressed file");
+
+    data[filter_offset] = 0;
+
+    const std::size_t channels {layout.channels};
+    const std::size_t width {layout.width};
+    const bool adaptive {filter == BmpFilter::Adaptive || filter == BmpFilter::AdaptivePlanes};
+    const bool planes {filter == BmpFilter::UpPlanes || filter == BmpFilter::AdaptivePlanes};
+    std::vector<unsigned char> residuals(width * channels);
+
+    for (std::size_t y = 0; y < layout.rows; ++y)
+    {
+        unsigned char * const row {reinterpret_cast<unsigned char *> (data + layout.offset + y * layout.row_size)};
+        const unsigned char * const above {y > 0 ? row - layout.row_size : nullptr};
+        const unsigned char * const before_above {y > 1 ? row - 2 * layout.row_size : nullptr};
+        const Predictor predictor {adaptive ? choose(above, before_above, layout) : Predictor::Up};
+
+        std::memcpy(residuals.data(), row, residuals.size());
+
+        // left to right, so that the pixel to the left is already restored
+        for (std::size_t x = 0; x < width; ++x)
+            for (std::size_t c = 0; c < channels; ++c)
+            {
+                const std::size_t b {x * channels + c};
+                const unsigned char prediction = predictor == Predictor::Sub ? (x > 0 ? row[b - channels] : 0)
+                                                                             : (above != nullptr ? above[b] : 0);
+
+                row[b] = static_cast<unsigned char> (residuals[planes ? c * width + x : b] + prediction);
+            }
+    }
+}
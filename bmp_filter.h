@@ -0,0 +1,72 @@
+#ifndef MEGALZW_BMP_FILTER_H
+#define MEGALZW_BMP_FILTER_H
+
+#include <cstddef>
+#include <functional>
+
+
+/**
+     * Reversible transforms of the pixels of a BMP image, which make them
+     * compress much better.
+     *
+     * Every row can be replaced by its differences from a prediction,
+     * PNG-style: each byte is predicted by the same byte of the row above
+     * (Up), or, for an adaptive filter, by either that or the same channel
+     * of the pixel to its left (Sub), whichever would have worked best on the
+     * row before, so that the choice need not be stored. The bytes of the row
+     * can then be grouped by channel, all blue ones, then all green ones, and
+     * so on.
+     *
+     * Only uncompressed images of 24 or 32 bits per pixel are transformed.
+     * The transform used is recorded in the first reserved byte of the file
+     * header, which must be zero; the rest of the headers, row padding and
+     * anything after the pixels are left as they are, and the size of the
+     * data does not change.
+*/
+
+/// Transforms of `bmp_filter()`.
+enum class BmpFilter {
+    None,           ///< pixels left as they are
+    Up,
+    UpPlanes,       ///< Up, then grouped by channel
+    Adaptive,
+    AdaptivePlanes  ///< Up or Sub, then grouped by channel
+};
+
+/// Returns whether the `size` bytes at `data` are an image that `bmp_filter()` transforms.
+bool filterable_bmp(const char *data, std::size_t size);
+
+/**
+     * Picks the transform that makes the image compress best.
+     *
+     * Every transform is tried on the same rows, about 256 KiB from the
+     * middle of the image, rather than on all of it.
+     *
+     * @param data             BMP file, for which `filterable_bmp()` holds
+     * @param size             number of bytes at `data`
+     * @param compressed_size  returns the compressed size of the bytes it is given
+     * @return                 transform whose sample compressed to the fewest bytes
+*/
+BmpFilter choose_bmp_filter(const char *data, std::size_t size,
+                            const std::function<std::size_t (const char *, std::size_t)> &compressed_size);
+
+/**
+     * Transforms the image at `data`.
+     *
+     * @param data         BMP file, for which `filterable_bmp()` holds
+     * @param size         number of bytes at `data`
+     * @param filter       transform, other than `BmpFilter::None`
+     * @param [out] out    `size` bytes receiving the transformed file
+*/
+void bmp_filter(const char *data, std::size_t size, BmpFilter filter, char *out);
+
+/**
+     * Undoes `bmp_filter()` in place.
+     *
+     * @param [in,out] data    transformed file
+     * @param size             number of bytes at `data`
+     * @throw std::runtime_error if `data` is not a transformed BMP file
+*/
+void bmp_unfilter(char *data, std::size_t size);
+
+#endif // MEGALZW_BMP_FILTER_H
@@ -0,0 +1,1195 @@
+#ifndef MEGALZW_CODEC_H
+#define MEGALZW_CODEC_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "bitio.h"
+#include "context_pool.h"
+#include "dictionary.h"
+#include "format.h"
+#include "lzw.h"
+#include "run_length.h"
+#include "seed_dictionary.h"
+
+
+/**
+     * Byte source over memory, with the `get()` of `std::istream` that the
+     * compressor needs.
+*/
+struct MemoryInput
+{
+    const char *first;
+    const char *last;
+
+    bool get(char &c)
+    {
+        if (first == last)
+            return false;
+
+        c = *first++;
+        return true;
+    }
+
+    /// Returns the number of bytes equal to `c` that come next.
+    std::size_t run(char c) const
+    {
+        return run_length(first, last, c);
+    }
+
+    /// Skips `n` bytes, at most as many as `run()` returned.
+    void skip(std::size_t n)
+    {
+        first += n;
+    }
+};
+
+
+/**
+     * Byte source over an input stream, read a chunk at a time so that the
+     * compressor's `get()` is a pointer bump rather than a stream call.
+*/
+class StreamInput
+{
+public:
+
+    explicit StreamInput(std::istream &is):
+        is_(is),
+        chunk_(chunk_size),
+        first_ {chunk_.data()},
+        last_ {chunk_.data()}
+    {
+    }
+
+    StreamInput(const StreamInput &) = delete;
+    StreamInput &operator=(const StreamInput &) = delete;
+
+    bool get(char &c)
+    {
+        if (first_ == last_ && !refill())
+            return false;
+
+        c = *first_++;
+        return true;
+    }
+
+    /// Returns the number of bytes equal to `c` that come next, among those already read.
+    std::size_t run(char c) const
+    {
+        return run_length(first_, last_, c);
+    }
+
+    /// Skips `n` bytes, at most as many as `run()` returned.
+    void skip(std::size_t n)
+    {
+        first_ += n;
+    }
+
+private:
+
+    static const std::size_t chunk_size {64 * 1024};
+
+    bool refill()
+    {
+        is_.read(chunk_.data(), chunk_.size());
+        first_ = chunk_.data();
+        last_ = first_ + is_.gcount();
+        return first_ != last_;
+    }
+
+    std::istream &is_;
+    std::vector<char> chunk_;
+    const char *first_;     ///< next byte of the chunk
+    const char *last_;      ///< end of the bytes read into the chunk
+};
+
+
+/**
+     * Byte sink over an output stream, collecting the decoded strings into
+     * chunks so that the stream is written once per chunk, not once per code.
+*/
+class StreamOutput
+{
+public:
+
+    explicit StreamOutput(std::ostream &os):
+        os_(os),
+        chunk_(chunk_size),
+        used_ {0}
+    {
+    }
+
+    StreamOutput(const StreamOutput &) = delete;
+    StreamOutput &operator=(const StreamOutput &) = delete;
+
+    void write(const char *s, std::size_t n)
+    {
+        if (used_ + n > chunk_.size())
+        {
+            flush();
+
+            if (n > chunk_.size())
+            {
+                os_.write(s, n);
+                return;
+            }
+        }
+
+        std::memcpy(chunk_.data() + used_, s, n);
+        used_ += n;
+    }
+
+    /// Writes out what is left in the chunk.
+    void flush()
+    {
+        os_.write(chunk_.data(), used_);
+        used_ = 0;
+    }
+
+private:
+
+    static const std::size_t chunk_size {64 * 1024};
+
+    std::ostream &os_;
+    std::vector<char> chunk_;
+    std::size_t used_;      ///< number of bytes of the chunk in use
+};
+
+
+/**
+     * Byte sink appending to a vector, with the `write()` of `std::ostream`
+     * that the decompressor needs.
+*/
+struct VectorOutput
+{
+    std::vector<char> &out;
+
+    void write(const char *s, std::size_t n)
+    {
+        out.insert(out.end(), s, s + n);
+    }
+};
+
+
+/**
+     * Byte sink filling a preallocated span of memory; writing past its end
+     * means the compressed data did not match the size it claimed.
+*/
+struct SpanOutput
+{
+    char *first;
+    char *last;
+
+    void write(const char *s, std::size_t n)
+    {
+        if (n > static_cast<std::size_t> (last - first))
+            throw std::runtime_error("corrupted compressed file");
+
+        std::memcpy(first, s, n);
+        first += n;
+    }
+};
+
+
+/**
+     * Byte sink passing on to `os` only the `length` bytes that start `offset`
+     * bytes into the data, and dropping the rest.
+*/
+struct WindowOutput
+{
+    std::ostream &os;
+    std::uint64_t offset;
+    std::uint64_t length;
+
+    void write(const char *s, std::size_t n)
+    {
+        if (offset >= n)
+        {
+            offset -= n;
+            return;
+        }
+
+        s += offset;
+        n -= static_cast<std::size_t> (offset);
+        offset = 0;
+
+        const std::size_t count {static_cast<std::size_t> (std::min<std::uint64_t> (n, length))};
+
+        os.write(s, count);
+        length -= count;
+    }
+};
+
+
+/// Work done by the codec loops, reported through `Stats`.
+struct CodeCounts
+{
+    std::uint64_t codes;    ///< codes written or read
+    std::uint64_t resets;   ///< times the dictionary filled up and started over
+
+    void add(const CodeCounts &other)
+    {
+        codes += other.codes;
+        resets += other.resets;
+    }
+};
+
+
+/**
+     * Returns the width of the first code once the dictionary starts over
+     * with `size` strings: the decoder reads codes up to `size`.
+*/
+inline unsigned int first_code_width(std::size_t size)
+{
+    unsigned int width {min_code_width};
+
+    while ((size >> width) != 0)
+        ++width;
+
+    return width;
+}
+
+
+/**
+     * Compressor state that survives between pieces of input: the dictionary,
+     * the pending prefix and the width the decoder will read the next code at.
+     *
+     * By default the dictionary is reset whenever it fills up. With a clear
+     * code, a full dictionary is kept and the ratio achieved since it filled
+     * up is checked every `check_interval` input bytes, as Unix `compress`
+     * does; once the ratio stops improving, the clear code is sent and both
+     * sides reset. A `RecyclingDictionary` is never reset, it makes room for
+     * new strings itself.
+     *
+     * Runs of a single byte are compressed in bulk. The strings of `n` times
+     * the same byte form a chain in the dictionary, which a run grows one
+     * string per code, so the encoder keeps that chain for every byte and
+     * follows it without looking each byte up. The codes are the same as
+     * byte by byte, and a run of `n` bytes costs about `sqrt(2 n)` lookups
+     * rather than `n`. A recycling dictionary can replace strings in the
+     * middle of a chain, so it goes byte by byte.
+     *
+     * With a seed, both dictionaries start over from its strings rather than
+     * from the single bytes alone, and the codes from a wider first width.
+     *
+     * @tparam Bits        maximum code width
+     * @tparam Dictionary  compressor dictionary engine, `FlatDictionary`, `MapDictionary`
+     *                     or `RecyclingDictionary`
+*/
+template <unsigned int Bits, typename Dictionary>
+class CodeEncoder
+{
+public:
+
+    using CodeType = typename CodeTraits<Bits>::CodeType;
+
+    /**
+     * @param clear_code   whether to keep a full dictionary until sending a clear code
+     * @param seed         strings both dictionaries start from, alive as long as the encoder
+    */
+    explicit CodeEncoder(bool clear_code = false, const Seed &seed = no_seed):
+        runs_(256)
+    {
+        restart(clear_code, seed);
+    }
+
+    CodeEncoder(const CodeEncoder &) = delete;
+    CodeEncoder &operator=(const CodeEncoder &) = delete;
+
+    /**
+     * Starts over on a new input, keeping the storage of the dictionary,
+     * with the same parameters as the constructor.
+    */
+    void restart(bool clear_code, const Seed &seed)
+    {
+        dictionary_.reseed(seed);
+        clear_code_ = clear_code;
+        base_ = static_cast<CodeType> (256 + seed.size);
+        first_width_ = first_code_width(256 + seed.size);
+
+        // the decoder adds no code for the first code it reads, and the ones after
+        // it each add one; codes are as wide as the decoder's dictionary needs
+        decoder_size_ = static_cast<CodeType> (base_ - 1);
+        width_ = first_width_;
+        i_ = CodeTraits<Bits>::dms;
+        counts_ = CodeCounts {0, 0};
+        full_bytes_ = 0;
+        full_codes_ = 0;
+        best_ratio_ = 0;
+        checked_bytes_ = 0;
+        reset_runs();
+    }
+
+    /**
+     * Compresses the bytes of `is`; the codes of the string still being
+     * matched when `is` runs out wait for more input or `finish()`.
+     *
+     * @tparam Input       `StreamInput` or `MemoryInput`
+     * @param [in] is      input
+     * @param [out] writer destination of the codes
+    */
+    template <typename Input>
+    void encode(Input &is, CodeWriter &writer)
+    {
+        const CodeType dms {CodeTraits<Bits>::dms};
+
+        // kept in locals so that they can live in registers
+        CodeType decoder_size {decoder_size_};
+        unsigned int width {width_};
+        CodeType i {i_}; // Index
+        std::uint64_t codes {counts_.codes};
+        char c;
+
+        while (is.get(c))
+        {
+            // dictionary's maximum size was reached
+            if (dictionary_.size() == dms && !Dictionary::recycles)
+            {
+                if (clear_code_)
+                {
+                    encode_full(c, writer, i, decoder_size, width, codes);
+                    continue;
+                }
+
+                dictionary_.reset();
+                reset_runs();
+                ++counts_.resets;
+            }
+
+            const CodeType k {dictionary_.search_and_insert(i, c)};
+
+            if (k == dms)
+            {
+                std::vector<CodeType> &run = runs_[static_cast<unsigned char> (c)];
+
+                // the string `i` + `c` is the next one of the chain of `c`
+                if (!Dictionary::recycles && run.back() == i)
+                    run.push_back(static_cast<CodeType> (dictionary_.size() - 1));
+
+                write_code(writer, i, decoder_size, width);
+                ++codes;
+                i = dictionary_.search_initials(c);
+
+                if constexpr (!Dictionary::recycles)
+                    encode_run(is, writer, c, i, decoder_size, width, codes);
+            }
+            else
+                i = k;
+        }
+
+        decoder_size_ = decoder_size;
+        width_ = width;
+        i_ = i;
+        counts_.codes = codes;
+    }
+
+    /// Writes the code of the string still being matched, if any.
+    void finish(CodeWriter &writer)
+    {
+        if (i_ != CodeTraits<Bits>::dms)
+        {
+            write_code(writer, i_, decoder_size_, width_);
+            ++counts_.codes;
+        }
+
+        i_ = CodeTraits<Bits>::dms;
+    }
+
+    /// Returns the work done so far.
+    const CodeCounts &counts() const
+    {
+        return counts_;
+    }
+
+    /**
+     * Returns the bytes an encoder takes at most, its dictionary included,
+     * and runs as long as the dictionary has codes.
+    */
+    static std::size_t storage()
+    {
+        return sizeof (CodeEncoder) + Dictionary::storage() + 256 * sizeof (std::vector<CodeType>)
+               + CodeTraits<Bits>::dms * sizeof (CodeType);
+    }
+
+private:
+
+    /// Input bytes between two checks of the ratio of a full dictionary.
+    static const std::uint64_t check_interval {16 * 1024};
+
+    void write_code(CodeWriter &writer, CodeType k, CodeType &decoder_size, unsigned int &width) const
+    {
+        writer.write(k, width);
+
+        // with a clear code, the decoder's dictionary stays full until it reads
+        // one; a recycling one stays full for good
+        if (decoder_size == CodeTraits<Bits>::dms)
+            return;
+
+        if (++decoder_size == CodeTraits<Bits>::dms && !clear_code_ && !Dictionary::recycles)
+            decoder_size = base_;
+
+        width = decoder_size == base_ ? first_width_ : width + ((decoder_size >> width) != 0);
+    }
+
+    /// Empties the chains of runs, down to the single bytes and the runs of the seed.
+    void reset_runs()
+    {
+        for (int c = 0; c < 256; ++c)
+        {
+            std::vector<CodeType> &run = runs_[c];
+
+            run.assign(1, dictionary_.search_initials(static_cast<char> (c)));
+
+            for (CodeType k; (k = dictionary_.search(run.back(), static_cast<char> (c))) != CodeTraits<Bits>::dms; )
+                run.push_back(k);
+        }
+    }
+
+    /**
+     * Compresses the bytes `c` that come next in `is`, while the dictionary
+     * has room for the strings they add.
+     *
+     * @param c            byte of the run
+     * @param [in,out] i   code of the single byte `c`; then of the string being matched
+    */
+    template <typename Input>
+    void encode_run(Input &is, CodeWriter &writer, char c, CodeType &i, CodeType &decoder_size, unsigned int &width,
+                    std::uint64_t &codes)
+    {
+        const std::size_t n {is.run(c)};
+
+        if (n == 0)
+            return;
+
+        std::vector<CodeType> &run = runs_[static_cast<unsigned char> (c)];
+        std::size_t length {1};     // `i` is `c` repeated `length` times
+        std::size_t left {n};
+
+        while (length + left > run.size() && dictionary_.size() != CodeTraits<Bits>::dms)
+        {
+            // the longest string of the chain, then one more byte that is not in the dictionary
+            left -= run.size() - length + 1;
+
+            const CodeType longest {run.back()};
+
+            dictionary_.search_and_insert(longest, c);
+            run.push_back(static_cast<CodeType> (dictionary_.size() - 1));
+            write_code(writer, longest, decoder_size, width);
+            ++codes;
+            length = 1;
+        }
+
+        // a full dictionary is reset or checked before the next byte, which therefore goes byte by byte
+        if (dictionary_.size() != CodeTraits<Bits>::dms && length + left <= run.size())
+        {
+            length += left;
+            left = 0;
+        }
+
+        i = run[length - 1];
+        is.skip(n - left);
+    }
+
+    /// Compresses byte `c` with a full dictionary, which only looks strings up.
+    void encode_full(char c, CodeWriter &writer, CodeType &i, CodeType &decoder_size, unsigned int &width,
+                     std::uint64_t &codes)
+    {
+        ++full_bytes_;
+
+        const CodeType k {dictionary_.search(i, c)};
+
+        if (k != CodeTraits<Bits>::dms)
+        {
+            i = k;
+            return;
+        }
+
+        write_code(writer, i, decoder_size, width);
+        ++codes;
+        ++full_codes_;
+        i = dictionary_.search_initials(c);
+
+        if (full_bytes_ < checked_bytes_ + check_interval)
+            return;
+
+        // input bytes per code since the dictionary filled up, in 1/256ths
+        const std::uint64_t ratio {(full_bytes_ << 8) / full_codes_};
+
+        checked_bytes_ = full_bytes_;
+
+        if (ratio > best_ratio_)
+        {
+            best_ratio_ = ratio;
+            return;
+        }
+
+        // codes are `Bits` wide while the decoder's dictionary is full
+        writer.write(CodeTraits<Bits>::dms, Bits);
+        dictionary_.reset();
+        reset_runs();
+        ++counts_.resets;
+
+        // the decoder resets like at the start: it adds no code for the next one
+        decoder_size = static_cast<CodeType> (base_ - 1);
+        width = first_width_;
+        full_bytes_ = 0;
+        full_codes_ = 0;
+        best_ratio_ = 0;
+        checked_bytes_ = 0;
+    }
+
+    Dictionary dictionary_;
+    bool clear_code_;
+    CodeType base_;                 ///< size of the dictionaries once they start over
+    unsigned int first_width_;      ///< width of the first code once they do
+    CodeType decoder_size_;     ///< size of the decoder's dictionary once it has read the codes so far
+    unsigned int width_;        ///< width of the next code
+    CodeType i_;                ///< code of the string being matched, or `dms` for none
+    CodeCounts counts_;
+
+    /**
+     * For every byte, the codes of the strings of 1, 2, ... times that byte,
+     * as far as the dictionary has them; kept across restarts, with their storage.
+    */
+    std::vector<std::vector<CodeType>> runs_;
+
+    std::uint64_t full_bytes_;      ///< input bytes since the dictionary filled up
+    std::uint64_t full_codes_;      ///< codes written since the dictionary filled up
+    std::uint64_t best_ratio_;      ///< best ratio seen at a check since then
+    std::uint64_t checked_bytes_;   ///< `full_bytes_` at the last check
+};
+
+
+/**
+     * Compresses the bytes of `is` into variable-width codes.
+     *
+     * @tparam Bits        maximum code width
+     * @tparam Dictionary  compressor dictionary engine, `FlatDictionary`, `MapDictionary`
+     *                     or `RecyclingDictionary`
+     * @tparam Input       `StreamInput` or `MemoryInput`
+     * @param [in] is      input
+     * @param [out] writer destination of the codes
+     * @param clear_code   whether to keep a full dictionary until sending a clear code
+     * @param seed         strings both dictionaries start from
+     * @return             work done
+*/
+template <unsigned int Bits, typename Dictionary, typename Input>
+CodeCounts compress_codes(Input &is, CodeWriter &writer, bool clear_code, const Seed &seed)
+{
+    // the encoder, and the storage of its dictionary, of an earlier call if there is one
+    const typename ContextPool<CodeEncoder<Bits, Dictionary>>::Lease encoder {
+        ContextPool<CodeEncoder<Bits, Dictionary>>::acquire()
+    };
+
+    encoder->restart(clear_code, seed);
+    encoder->encode(is, writer);
+    encoder->finish(writer);
+    return encoder->counts();
+}
+
+
+/// Runs `compress_codes()` with the dictionary engine, full dictionary policy and seed picked by `options`.
+template <unsigned int Bits, typename Input>
+CodeCounts compress_codes(Input &is, CodeWriter &writer, const Options &options)
+{
+    const bool clear_code {options.full_dictionary == FullDictionary::Clear};
+    const Seed seed {options.seed != nullptr ? options.seed->seed(Bits) : no_seed};
+
+    if (options.full_dictionary == FullDictionary::Recycle)
+        return compress_codes<Bits, RecyclingDictionary<Bits>>(is, writer, false, seed);
+
+    if (options.engine == DictionaryEngine::Map)
+        return compress_codes<Bits, MapDictionary<Bits>>(is, writer, clear_code, seed);
+
+    return compress_codes<Bits, FlatDictionary<Bits>>(is, writer, clear_code, seed);
+}
+
+
+/**
+     * Runs `compress_codes()` with the code width, dictionary engine and reset
+     * policy picked at run time.
+     *
+     * @param options  code width, one of `supported_code_width()`, dictionary engine and reset policy
+*/
+template <typename Input>
+CodeCounts compress_codes(Input &is, CodeWriter &writer, const Options &options)
+{
+    switch (options.bits)
+    {
+        case 12:
+            return compress_codes<12>(is, writer, options);
+
+        case 16:
+            return compress_codes<16>(is, writer, options);
+
+        case 20:
+            return compress_codes<20>(is, writer, options);
+
+        case 24:
+            return compress_codes<24>(is, writer, options);
+
+        default:
+            throw std::invalid_argument("unsupported code width");
+    }
+}
+
+
+/// Returns the bytes the encoder of `compress_codes()` takes at most, for codes at most `Bits` wide.
+template <unsigned int Bits>
+std::size_t encoder_storage(const Options &options)
+{
+    if (options.full_dictionary == FullDictionary::Recycle)
+        return CodeEncoder<Bits, RecyclingDictionary<Bits>>::storage();
+
+    if (options.engine == DictionaryEngine::Map)
+        return CodeEncoder<Bits, MapDictionary<Bits>>::storage();
+
+    return CodeEncoder<Bits, FlatDictionary<Bits>>::storage();
+}
+
+
+/**
+     * Returns the bytes the encoder of `compress_codes()` takes at most, with
+     * the code width, dictionary engine and reset policy of `options`.
+*/
+inline std::size_t encoder_storage(const Options &options)
+{
+    switch (options.bits)
+    {
+        case 12:
+            return encoder_storage<12>(options);
+
+        case 16:
+            return encoder_storage<16>(options);
+
+        case 20:
+            return encoder_storage<20>(options);
+
+        case 24:
+            return encoder_storage<24>(options);
+
+        default:
+            throw std::invalid_argument("unsupported code width");
+    }
+}
+
+
+/// How a stream of codes was written, as recorded in the header of its file.
+struct CodeFormat
+{
+    unsigned int bits;      ///< maximum code width
+    bool fixed_width;       ///< whether every code is `bits` wide, as in version 0 files
+    FullDictionary full_dictionary;
+    Seed seed;              ///< strings the dictionary starts from, for `bits`; empty but in version 4 files
+};
+
+
+/// How the codes of version 0 files were written.
+const CodeFormat legacy_code_format {16, true, FullDictionary::Reset, no_seed};
+
+
+/// Returns how the codes of a file with the version 1, 2 or 3 `header` were written, without a seed.
+inline CodeFormat header_code_format(const char *header)
+{
+    const std::uint8_t width {static_cast<std::uint8_t> (header[5])};
+
+    const std::uint8_t flags {static_cast<std::uint8_t> (width & ~format::width_mask & ~format::flag_bmp_filter)};
+
+    if ((flags & ~format::known_flags) != 0 || flags == (format::flag_clear_code | format::flag_recycle))
+        throw std::runtime_error("unsupported file format flags");
+
+    return CodeFormat {
+        static_cast<unsigned int> (width & format::width_mask),
+        false,
+        flags == format::flag_clear_code ? FullDictionary::Clear :
+        flags == format::flag_recycle ? FullDictionary::Recycle : FullDictionary::Reset,
+        no_seed
+    };
+}
+
+
+/// Returns the width byte of the header of a file compressed with `options`, without the filter flag.
+inline char header_width(const Options &options)
+{
+    const std::uint8_t flags {
+        options.full_dictionary == FullDictionary::Clear ? format::flag_clear_code :
+        options.full_dictionary == FullDictionary::Recycle ? format::flag_recycle : std::uint8_t {0}
+    };
+
+    return static_cast<char> (options.bits | flags);
+}
+
+
+/**
+     * Decompressor state that survives between pieces of input: the dictionary,
+     * the previous code and its string, and the width of the next code.
+     *
+     * @tparam Bits        maximum code width
+*/
+template <unsigned int Bits>
+class CodeDecoder
+{
+public:
+
+    using CodeType = typename CodeTraits<Bits>::CodeType;
+
+    CodeDecoder():
+        strings_(strings_size)
+    {
+        restart(CodeFormat {Bits, false, FullDictionary::Reset, no_seed});
+    }
+
+    /// @param code_format     how the codes were written, with a dictionary that is reset or cleared
+    explicit CodeDecoder(const CodeFormat &code_format):
+        strings_(strings_size)
+    {
+        restart(code_format);
+    }
+
+    CodeDecoder(const CodeDecoder &) = delete;
+    CodeDecoder &operator=(const CodeDecoder &) = delete;
+
+    /// Starts over on new codes, keeping the storage of the dictionary and the string.
+    void restart(const CodeFormat &code_format)
+    {
+        dictionary_.reseed(code_format.seed);
+        fixed_width_ = code_format.fixed_width;
+        clear_code_ = code_format.full_dictionary == FullDictionary::Clear;
+        first_width_ = first_code_width(dictionary_.size());
+        i_ = CodeTraits<Bits>::dms;
+        length_ = 0;
+        width_ = fixed_width_ ? Bits : first_width_;
+        counts_ = CodeCounts {0, 0};
+    }
+
+    /**
+     * Decodes codes until `reader` runs out of them and writes the result to `os`.
+     *
+     * @tparam Output      `StreamOutput`, `VectorOutput`, `SpanOutput` or `WindowOutput`
+     * @param [in] reader  source of the codes
+     * @param [out] os     output
+    */
+    template <typename Output>
+    void decode(CodeReader &reader, Output &os)
+    {
+        const CodeType dms {CodeTraits<Bits>::dms};
+
+        // kept in locals so that they can live in registers
+        CodeType i {i_}; // Index
+        std::uint32_t k; // Key
+        std::size_t length {length_}; // length of the string of `i`, which is still in `s_`
+        unsigned int width {width_};
+        std::uint64_t codes {counts_.codes};
+
+        while (true)
+        {
+            // dictionary's maximum size was reached
+            if (dictionary_.size() == dms && !clear_code_)
+            {
+                dictionary_.reset();
+                ++counts_.resets;
+
+                if (!fixed_width_)
+                    width = first_width_;
+            }
+
+            if (!fixed_width_ && (dictionary_.size() >> width) != 0)
+                ++width;
+
+            // without clear codes, a code the batch checks reject is corrupted, whatever the codes around it
+            if (!clear_code_ && i < dictionary_.size() && dictionary_.complete())
+            {
+                const std::size_t count {decode_batch(reader, os, i, width)};
+
+                codes += count;
+
+                if (count == 0)
+                    break;
+
+                length = dictionary_.length(i);
+
+                if (s_.size() < length + 1)
+                    s_.resize(std::max<std::size_t> (length + 1, 2 * s_.size()));
+
+                // the string of the last code is where the checked loop expects it
+                dictionary_.copy_string(i, &s_[length]);
+                continue;
+            }
+
+            if (!reader.read(k, width))
+                break;
+
+            if (k >= dictionary_.size())
+            {
+                if (clear_code_ && k == dms)
+                {
+                    // the next code starts over, like the first one
+                    dictionary_.reset();
+                    ++counts_.resets;
+                    width = first_width_;
+                    i = dms;
+                    continue;
+                }
+
+                if (k > dictionary_.size() || i == dms || i >= dictionary_.size())
+                    throw std::runtime_error("invalid compressed code");
+
+                if (s_.size() < length + 2)
+                    s_.resize(2 * s_.size());
+
+                // the string of `k` is the previous string plus its own first byte
+                dictionary_.push_back(i, s_.front());
+                s_[length++] = s_.front();
+            }
+            else
+            {
+                if (!dictionary_.valid(static_cast<CodeType> (k)))
+                    throw std::runtime_error("invalid compressed code");
+
+                length = dictionary_.length(static_cast<CodeType> (k));
+
+                if (s_.size() < length + 1)
+                    s_.resize(std::max<std::size_t> (length + 1, 2 * s_.size()));
+
+                dictionary_.copy_string(static_cast<CodeType> (k), &s_[length]);
+
+                // a full dictionary only grows again after a clear code
+                if (i != dms && dictionary_.size() != dms)
+                    dictionary_.push_back(i, s_.front());
+            }
+
+            os.write(&s_.front(), length);
+            i = static_cast<CodeType> (k);
+            ++codes;
+        }
+
+        i_ = i;
+        length_ = length;
+        width_ = width;
+        counts_.codes = codes;
+    }
+
+    /// Returns the work done so far.
+    const CodeCounts &counts() const
+    {
+        return counts_;
+    }
+
+private:
+
+    /// Most codes `decode_batch()` reads at a time.
+    static const std::size_t batch_size {256};
+
+    /// Size of `strings_`, unless a string is longer.
+    static const std::size_t strings_size {32 * 1024};
+
+    /**
+     * Decodes a batch of codes of the same width, after the valid code `i`,
+     * that the dictionary can grow by one string each without filling up.
+     *
+     * The codes are read first, and checked at once: each is at most the
+     * size the dictionary has when it comes, which grows by one per code,
+     * so that all are valid codes or the string `i` + its first byte that
+     * is added as they come. The strings are then copied without checks into
+     * `strings_`, which is written to `os` once full and at the end; that of
+     * a code just added is the string before it, copied in one piece.
+     *
+     * @param [in] reader  source of the codes
+     * @param [out] os     output
+     * @param [in,out] i   previous code, valid and below `size()`; the last code of the batch
+     * @param width        width of the codes
+     * @return             number of codes decoded, fewer than asked for if `reader` ran out
+     * @throw std::runtime_error if one of the codes is invalid
+    */
+    template <typename Output>
+    std::size_t decode_batch(CodeReader &reader, Output &os, CodeType &i, unsigned int width)
+    {
+        const std::uint32_t size {dictionary_.size()};
+        const std::size_t count {std::min<std::size_t> (std::size_t {batch_size}, std::min<std::uint32_t> (
+            CodeTraits<Bits>::dms - size, (std::uint32_t {1} << width) - size))};
+
+        std::uint32_t batch[batch_size];
+        std::size_t read {0};
+
+        while (read < count && reader.read(batch[read], width))
+            ++read;
+
+        // a branchless reduction the compiler can vectorize
+        std::uint32_t invalid {0};
+
+        for (std::size_t n = 0; n < read; ++n)
+            invalid |= static_cast<std::uint32_t> (batch[n] > size + n);
+
+        if (invalid != 0)
+            throw std::runtime_error("invalid compressed code");
+
+        std::size_t used {0};
+        std::size_t last {0};   // length of the string of `i` at the end of `strings_`, 0 if it is not there
+
+        for (std::size_t n = 0; n < read; ++n)
+        {
+            const CodeType k {static_cast<CodeType> (batch[n])};
+            const bool added {k == dictionary_.size()};
+
+            // for the code being added, the string of `i` plus its own first byte, whose first byte is that of `i`
+            dictionary_.push_back(i, dictionary_.first(added ? i : k));
+
+            const std::size_t length {dictionary_.length(k)};
+
+            // the strings before that of `i` are written once they fill `strings_`, so that it stays in the cache
+            if (used + length > strings_.size())
+            {
+                os.write(strings_.data(), used - last);
+                std::memmove(strings_.data(), strings_.data() + used - last, last);
+                used = last;
+
+                if (used + length > strings_.size())
+                    strings_.resize(used + length);
+            }
+
+            char * const string {&strings_[used]};
+
+            // a run of codes each adding to the string before, as in long runs of a byte, copies it whole
+            if (added && last != 0)
+            {
+                std::memcpy(string, string - last, last);
+                string[last] = string[0];
+            }
+            else
+                dictionary_.copy_string(k, string + length);
+
+            used += length;
+            last = length;
+            i = k;
+        }
+
+        os.write(strings_.data(), used);
+        return read;
+    }
+
+    DecoderDictionary<Bits> dictionary_;
+    bool fixed_width_;
+    bool clear_code_;
+    unsigned int first_width_;  ///< width of the first code after a reset
+    std::vector<char> s_;       ///< String, reused for every code
+    std::vector<char> strings_; ///< strings of the codes of a batch
+    CodeType i_;                ///< previous code, or `dms` for none
+    std::size_t length_;        ///< length of the string of `i_`
+    unsigned int width_;        ///< width of the next code, before the dictionary grows
+    CodeCounts counts_;
+};
+
+
+/**
+     * Decompressor state for codes written with a `RecyclingDictionary`.
+     *
+     * The decoder adds the string of the previous code plus the first byte of
+     * the current one, so it learns every string one code after the encoder.
+     * It updates its `LeafQueue` in the same order nonetheless: the encoder
+     * adds a string right after writing its prefix, the decoder right before
+     * reading the code after that prefix. Both therefore pick the same leaf to
+     * replace, and a code equal to the one being filled in is the string of
+     * the previous code plus its own first byte, just like the next code of a
+     * growing dictionary.
+     *
+     * @tparam Bits        maximum code width
+*/
+template <unsigned int Bits>
+class RecyclingDecoder
+{
+public:
+
+    using CodeType = typename CodeTraits<Bits>::CodeType;
+
+    RecyclingDecoder()
+    {
+        restart(CodeFormat {Bits, false, FullDictionary::Recycle, no_seed});
+    }
+
+    /// @param code_format     how the codes were written, with a recycling dictionary
+    explicit RecyclingDecoder(const CodeFormat &code_format)
+    {
+        restart(code_format);
+    }
+
+    RecyclingDecoder(const RecyclingDecoder &) = delete;
+    RecyclingDecoder &operator=(const RecyclingDecoder &) = delete;
+
+    /// Same as `CodeDecoder::restart()`.
+    void restart(const CodeFormat &code_format)
+    {
+        dictionary_.reseed(code_format.seed);
+        leaves_.reset();
+
+        // in the order the encoder's dictionary adds them
+        for (std::size_t n = 0; n < code_format.seed.size; ++n)
+            leaves_.add(static_cast<CodeType> (256 + n), static_cast<CodeType> (code_format.seed.prefix(n)));
+
+        i_ = CodeTraits<Bits>::dms;
+        length_ = 0;
+        width_ = first_code_width(dictionary_.size());
+        counts_ = CodeCounts {0, 0};
+    }
+
+    /// Same as `CodeDecoder::decode()`.
+    template <typename Output>
+    void decode(CodeReader &reader, Output &os)
+    {
+        const CodeType dms {CodeTraits<Bits>::dms};
+
+        // kept in locals so that they can live in registers
+        CodeType i {i_}; // Index
+        std::uint32_t k; // Key
+        std::size_t length {length_}; // length of the string of `i`, which is still in `s_`
+        unsigned int width {width_};
+        std::uint64_t codes {counts_.codes};
+
+        while (true)
+        {
+            if ((dictionary_.size() >> width) != 0)
+                ++width;
+
+            if (!reader.read(k, width))
+                break;
+
+            // code that the string of `i` plus the first byte of `k` is given, if any
+            CodeType slot {dms};
+
+            if (i != dms)
+                slot = dictionary_.size() != dms ? dictionary_.size() : leaves_.oldest(i);
+
+            if (k == slot && slot != dms)
+            {
+                if (s_.size() < length + 2)
+                    s_.resize(2 * s_.size());
+
+                // the string of `k` is the previous string plus its own first byte
+                s_[length++] = s_.front();
+            }
+            else
+            {
+                if (k >= dictionary_.size())
+                    throw std::runtime_error("invalid compressed code");
+
+                length = dictionary_.length(static_cast<CodeType> (k));
+
+                if (s_.size() < length + 1)
+                    s_.resize(std::max<std::size_t> (length + 1, 2 * s_.size()));
+
+                dictionary_.copy_string(static_cast<CodeType> (k), &s_[length]);
+            }
+
+            if (slot != dms)
+                add(slot, i, s_.front());
+
+            os.write(&s_.front(), length);
+            i = static_cast<CodeType> (k);
+            ++codes;
+        }
+
+        i_ = i;
+        length_ = length;
+        width_ = width;
+        counts_.codes = codes;
+    }
+
+    /// Returns the work done so far.
+    const CodeCounts &counts() const
+    {
+        return counts_;
+    }
+
+private:
+
+    /// Gives code `k`, the next one or the leaf picked by `leaves_`, the string `i` + `c`.
+    void add(CodeType k, CodeType i, char c)
+    {
+        if (k == dictionary_.size())
+            dictionary_.push_back(i, c);
+        else
+        {
+            leaves_.remove(k, dictionary_.prefix(k));
+            dictionary_.replace(k, i, c);
+        }
+
+        leaves_.add(k, i);
+    }
+
+    DecoderDictionary<Bits> dictionary_;
+    LeafQueue<Bits> leaves_;
+    std::vector<char> s_;       ///< String, reused for every code
+    CodeType i_;                ///< previous code, or `dms` for none
+    std::size_t length_;        ///< length of the string of `i_`
+    unsigned int width_;        ///< width of the next code, before the dictionary grows
+    CodeCounts counts_;
+};
+
+
+/**
+     * Decodes codes with `Decoder`, a `CodeDecoder` or a `RecyclingDecoder`
+     * of an earlier call if there is one, and checks the padding.
+*/
+template <typename Decoder, typename Output>
+CodeCounts run_decoder(CodeReader &reader, Output &os, const CodeFormat &code_format)
+{
+    const typename ContextPool<Decoder>::Lease decoder {ContextPool<Decoder>::acquire()};
+
+    decoder->restart(code_format);
+    decoder->decode(reader, os);
+
+    if (!reader.clean_end())
+        throw std::runtime_error("corrupted compressed file");
+
+    return decoder->counts();
+}
+
+
+/**
+     * Decodes codes written by `compress_codes()` and writes the result to `os`.
+     *
+     * @tparam Bits        maximum code width
+     * @tparam Output      `StreamOutput`, `VectorOutput`, `SpanOutput` or `WindowOutput`
+     * @param [in] reader  source of the codes
+     * @param [out] os     output
+     * @param code_format  how the codes were written; its width must be `Bits`
+     * @return             work done
+*/
+template <unsigned int Bits, typename Output>
+CodeCounts decompress_codes(CodeReader &reader, Output &os, const CodeFormat &code_format)
+{
+    if (code_format.full_dictionary == FullDictionary::Recycle)
+        return run_decoder<RecyclingDecoder<Bits>>(reader, os, code_format);
+
+    return run_decoder<CodeDecoder<Bits>>(reader, os, code_format);
+}
+
+
+/// Runs `decompress_codes()` with the code width of `code_format`, picked at run time.
+template <typename Output>
+CodeCounts decompress_codes(CodeReader &reader, Output &os, const CodeFormat &code_format)
+{
+    switch (code_format.bits)
+    {
+        case 12:
+            return decompress_codes<12>(reader, os, code_format);
+
+        case 16:
+            return decompress_codes<16>(reader, os, code_format);
+
+        case 20:
+            return decompress_codes<20>(reader, os, code_format);
+
+        case 24:
+            return decompress_codes<24>(reader, os, code_format);
+
+        default:
+            throw std::runtime_error("unsupported code width");
+    }
+}
+
+#endif // MEGALZW_CODEC_H
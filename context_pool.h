@@ -0,0 +1,144 @@
+#ifndef MEGALZW_CONTEXT_POOL_H
+#define MEGALZW_CONTEXT_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "parallel.h"
+
+
+/**
+     * Pools of codec states, shared by all threads.
+     *
+     * A codec state owns the dictionary, which is the bulk of its storage,
+     * allocated when the state is built. The calls of `compress()` and
+     * `decompress()` check a state out of the pool of its type, restart it
+     * and give it back once done, so that in steady state the storage of an
+     * earlier call is reused rather than allocated again. Each pool keeps
+     * as many free states as there are hardware threads, and threads of one
+     * call use states of their own, so a call on many threads finds enough.
+*/
+
+/// Functions emptying every pool that was used, for `release_codec_contexts()`.
+class ContextPools
+{
+public:
+
+    /// Adds `clear` to the functions `clear_all()` calls.
+    static void add(void (*clear)())
+    {
+        ContextPools &pools = instance();
+        std::lock_guard<std::mutex> lock(pools.mutex_);
+
+        pools.clears_.push_back(clear);
+    }
+
+    /// Destroys the free states of every pool.
+    static void clear_all()
+    {
+        ContextPools &pools = instance();
+        std::lock_guard<std::mutex> lock(pools.mutex_);
+
+        for (void (*clear)() : pools.clears_)
+            clear();
+    }
+
+private:
+
+    static ContextPools &instance()
+    {
+        static ContextPools pools;
+
+        return pools;
+    }
+
+    std::mutex mutex_;
+    std::vector<void (*)()> clears_;
+};
+
+
+/**
+     * Free codec states of type `T`, which is default-constructible and
+     * restarted by whoever checks one out.
+*/
+template <typename T>
+class ContextPool
+{
+public:
+
+    /// Gives a state checked out with `acquire()` back to the pool.
+    struct Release
+    {
+        void operator()(T *context) const
+        {
+            instance().release(context);
+        }
+    };
+
+    using Lease = std::unique_ptr<T, Release>;
+
+    /// Returns a free state, or a new one if there is none; it goes back to the pool when the lease ends.
+    static Lease acquire()
+    {
+        ContextPool &pool = instance();
+
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex_);
+
+            if (!pool.free_.empty())
+            {
+                Lease context(pool.free_.back().release());
+
+                pool.free_.pop_back();
+                return context;
+            }
+        }
+
+        return Lease(new T);
+    }
+
+    /// Destroys the free states.
+    static void clear()
+    {
+        ContextPool &pool = instance();
+        std::vector<std::unique_ptr<T>> free;
+
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex_);
+
+            free.swap(pool.free_);
+        }
+    }
+
+private:
+
+    ContextPool():
+        limit_ {thread_count(0)}
+    {
+        free_.reserve(limit_);
+        ContextPools::add(&ContextPool::clear);
+    }
+
+    static ContextPool &instance()
+    {
+        static ContextPool pool;
+
+        return pool;
+    }
+
+    void release(T *context)
+    {
+        std::unique_ptr<T> owned(context);
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (free_.size() < limit_)
+            free_.push_back(std::move(owned));
+    }
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<T>> free_;
+    const std::size_t limit_;   ///< number of free states kept
+};
+
+#endif // MEGALZW_CONTEXT_POOL_H
@@ -0,0 +1,253 @@
+#include "crc32c.h"
+
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#define MEGALZW_CRC32C_SSE42
+#include <nmmintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) && !defined(MEGALZW_NO_CPU_DISPATCH)
+// compiled for SSE 4.2 in a function of its own, used if the processor turns out to have it
+#define MEGALZW_CRC32C_SSE42
+#define MEGALZW_CRC32C_DISPATCH
+#define MEGALZW_CRC32C_TABLES
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define MEGALZW_CRC32C_ARM
+#include <arm_acle.h>
+#else
+#define MEGALZW_CRC32C_TABLES
+#endif
+
+
+namespace {
+
+/// The CRC-32C polynomial, bit-reversed.
+const std::uint32_t polynomial {0x82f63b78};
+
+
+#ifdef MEGALZW_CRC32C_TABLES
+
+/**
+     * Tables of slicing-by-8: `table[0]` is the usual byte-at-a-time table,
+     * and `table[k][b]` the checksum of byte `b` followed by `k` zero bytes.
+*/
+struct Tables
+{
+    std::uint32_t table[8][256];
+
+    Tables()
+    {
+        for (std::uint32_t b = 0; b < 256; ++b)
+        {
+            std::uint32_t crc {b};
+
+            for (int bit = 0; bit < 8; ++bit)
+                crc = crc & 1 ? crc >> 1 ^ polynomial : crc >> 1;
+
+            table[0][b] = crc;
+        }
+
+        for (int k = 1; k < 8; ++k)
+            for (std::uint32_t b = 0; b < 256; ++b)
+                table[k][b] = table[k - 1][b] >> 8 ^ table[0][table[k - 1][b] & 0xff];
+    }
+};
+
+
+/// Returns the checksum register after the bytes at `data`, eight at a time from the tables.
+std::uint32_t crc32c_tables(const unsigned char *data, std::size_t size, std::uint32_t crc)
+{
+    static const Tables tables;
+    const std::uint32_t (&t)[8][256] = tables.table;
+
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        const std::uint32_t low {crc ^ (data[0] | data[1] << 8 | data[2] << 16 | static_cast<std::uint32_t> (data[3]) << 24)};
+
+        crc = t[7][low & 0xff] ^ t[6][low >> 8 & 0xff] ^ t[5][low >> 16 & 0xff] ^ t[4][low >> 24]
+            ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+    }
+
+    for (; size > 0; ++data, --size)
+        crc = crc >> 8 ^ t[0][(crc ^ *data) & 0xff];
+
+    return crc;
+}
+
+#endif
+
+
+/**
+     * Returns the product of `a` and `b` modulo the polynomial, both bit-reversed
+     * like the checksums, the highest bit being the coefficient of x^0.
+*/
+std::uint32_t multiply(std::uint32_t a, std::uint32_t b)
+{
+    std::uint32_t product {0};
+
+    for (std::uint32_t m = std::uint32_t {1} << 31; m != 0; m >>= 1)
+    {
+        if (a & m)
+            product ^= b;
+
+        b = b & 1 ? b >> 1 ^ polynomial : b >> 1;
+    }
+
+    return product;
+}
+
+
+/**
+     * Returns x^(8 `size`) modulo the polynomial, the factor that appending
+     * `size` zero bytes multiplies a checksum register by, as zlib's
+     * `crc32_combine()` does.
+*/
+std::uint32_t zeros_factor(std::uint64_t size)
+{
+    struct Powers
+    {
+        std::uint32_t power[64];    ///< x^(2^k)
+
+        Powers()
+        {
+            power[0] = std::uint32_t {1} << 30;
+
+            for (int k = 1; k < 64; ++k)
+                power[k] = multiply(power[k - 1], power[k - 1]);
+        }
+    };
+
+    static const Powers powers;
+    std::uint32_t factor {std::uint32_t {1} << 31};
+
+    // 8 `size` has its bits 3 up
+    for (int k = 3; size != 0; size >>= 1, ++k)
+        if (size & 1)
+            factor = multiply(powers.power[k], factor);
+
+    return factor;
+}
+
+
+#if defined(MEGALZW_CRC32C_SSE42) || defined(MEGALZW_CRC32C_ARM)
+
+#ifdef MEGALZW_CRC32C_DISPATCH
+#define MEGALZW_CRC32C_TARGET __attribute__((target("sse4.2")))
+#else
+#define MEGALZW_CRC32C_TARGET
+#endif
+
+/// Bytes of each of the three parts of the data whose checksums `crc32c_hardware()` computes at once.
+const std::size_t stride {4096};
+
+
+/// Tables appending `stride` zero bytes to a checksum register, a byte of it at a time.
+struct ShiftTables
+{
+    std::uint32_t table[4][256];
+
+    ShiftTables()
+    {
+        const std::uint32_t factor {zeros_factor(stride)};
+
+        for (int k = 0; k < 4; ++k)
+            for (std::uint32_t b = 0; b < 256; ++b)
+                table[k][b] = multiply(factor, b << (8 * k));
+    }
+
+    std::uint32_t shift(std::uint32_t crc) const
+    {
+        return table[0][crc & 0xff] ^ table[1][crc >> 8 & 0xff] ^ table[2][crc >> 16 & 0xff] ^ table[3][crc >> 24];
+    }
+};
+
+
+/// Returns the checksum register after the 8 bytes at `data`.
+MEGALZW_CRC32C_TARGET inline std::uint32_t crc32c_word(std::uint32_t crc, const unsigned char *data)
+{
+    std::uint64_t word;
+
+    std::memcpy(&word, data, sizeof word);
+#ifdef MEGALZW_CRC32C_ARM
+    return __crc32cd(crc, word);
+#else
+    return static_cast<std::uint32_t> (_mm_crc32_u64(crc, word));
+#endif
+}
+
+
+/// Returns the checksum register after the byte `b`.
+MEGALZW_CRC32C_TARGET inline std::uint32_t crc32c_byte(std::uint32_t crc, unsigned char b)
+{
+#ifdef MEGALZW_CRC32C_ARM
+    return __crc32cb(crc, b);
+#else
+    return _mm_crc32_u8(crc, b);
+#endif
+}
+
+
+/**
+     * Returns the checksum register after the bytes at `data`, with the CRC32
+     * instructions of SSE 4.2 or ARMv8.
+     *
+     * One instruction has to wait for the one before, so three parts of the
+     * data go through them side by side, and their checksums are then joined
+     * by shifting the first two past the parts after them.
+*/
+MEGALZW_CRC32C_TARGET std::uint32_t crc32c_hardware(const unsigned char *data, std::size_t size, std::uint32_t crc)
+{
+    static const ShiftTables tables;
+
+    for (; size >= 3 * stride; data += 3 * stride, size -= 3 * stride)
+    {
+        std::uint32_t first {crc};
+        std::uint32_t second {0};
+        std::uint32_t third {0};
+
+        for (std::size_t i = 0; i < stride; i += 8)
+        {
+            first = crc32c_word(first, data + i);
+            second = crc32c_word(second, data + stride + i);
+            third = crc32c_word(third, data + 2 * stride + i);
+        }
+
+        crc = tables.shift(tables.shift(first) ^ second) ^ third;
+    }
+
+    for (; size >= 8; data += 8, size -= 8)
+        crc = crc32c_word(crc, data);
+
+    for (; size > 0; ++data, --size)
+        crc = crc32c_byte(crc, *data);
+
+    return crc;
+}
+
+#undef MEGALZW_CRC32C_TARGET
+
+#endif
+
+} // namespace
+
+
+std::uint32_t crc32c(const char *data, std::size_t size, std::uint32_t crc)
+{
+    const unsigned char * const bytes {reinterpret_cast<const unsigned char *> (data)};
+
+#if defined(MEGALZW_CRC32C_DISPATCH)
+    static const bool hardware {__builtin_cpu_supports("sse4.2") != 0};
+
+    return ~(hardware ? crc32c_hardware(bytes, size, ~crc) : crc32c_tables(bytes, size, ~crc));
+#elif defined(MEGALZW_CRC32C_SSE42) || defined(MEGALZW_CRC32C_ARM)
+    return ~crc32c_hardware(bytes, size, ~crc);
+#else
+    return ~crc32c_tables(bytes, size, ~crc);
+#endif
+}
+
+
+std::uint32_t crc32c_combine(std::uint32_t first, std::uint32_t second, std::uint64_t second_size)
+{
+    return multiply(zeros_factor(second_size), first) ^ second;
+}
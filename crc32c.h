@@ -0,0 +1,37 @@
+#ifndef MEGALZW_CRC32C_H
+#define MEGALZW_CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+     * CRC-32C (Castagnoli) checksums, the ones of iSCSI and ext4, which
+     * x86 processors since SSE 4.2 and ARMv8 ones compute in hardware.
+     *
+     * Checksums chain like zlib's `crc32()`: the checksum of `a` followed by
+     * `b` is `crc32c(b, size_b, crc32c(a, size_a))`.
+*/
+
+/**
+     * Returns the checksum of the `size` bytes at `data`, following the bytes whose checksum is `crc`.
+     *
+     * Uses the CRC32 instructions when the processor has them, checked once,
+     * and eight tables of 256 entries otherwise.
+     *
+     * @param data     bytes
+     * @param size     number of bytes at `data`
+     * @param crc      checksum of the bytes before, 0 for none
+*/
+std::uint32_t crc32c(const char *data, std::size_t size, std::uint32_t crc = 0);
+
+/**
+     * Returns the checksum of two pieces of data from the checksums of each.
+     *
+     * @param first        checksum of the first piece
+     * @param second       checksum of the second piece
+     * @param second_size  size of the second piece
+*/
+std::uint32_t crc32c_combine(std::uint32_t first, std::uint32_t second, std::uint64_t second_size);
+
+#endif // MEGALZW_CRC32C_H
@@ -0,0 +1,1010 @@
+#ifndef MEGALZW_DICTIONARY_H
+#define MEGALZW_DICTIONARY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+/**
+     * Code type and dictionary size of a codec whose codes are at most `Bits` wide.
+     *
+     * @tparam Bits    maximum code width, from 9 to 24
+*/
+template <unsigned int Bits>
+struct CodeTraits
+{
+    static_assert(Bits >= 9 && Bits <= 24, "code width out of range");
+
+    /// Type used to store and retrieve codes.
+    using CodeType = typename std::conditional<(Bits <= 16), std::uint16_t, std::uint32_t>::type;
+
+    /// Dictionary Maximum Size (when reached, the dictionary will be reset)
+    static constexpr CodeType dms {static_cast<CodeType> ((std::uint32_t {1} << Bits) - 1)};
+};
+
+template <unsigned int Bits>
+constexpr typename CodeTraits<Bits>::CodeType CodeTraits<Bits>::dms;
+
+
+/**
+     * Returns the code of the single-byte string `c`.
+     *
+     * The initial dictionary holds every `char` value in ascending order,
+     * so the code of `c` is its distance from `std::numeric_limits<char>::min()`.
+     *
+     * @param c    byte whose code is wanted
+     * @return     code in the range [0, 256)
+*/
+inline unsigned int initial_code(char c)
+{
+    return static_cast<unsigned int> (static_cast<long int> (c) - std::numeric_limits<char>::min());
+}
+
+
+/**
+     * Strings a dictionary holds from the start, after the 256 single bytes;
+     * see seed_dictionary.h.
+     *
+     * String `256 + n` is made of the string whose code is `keys[n] >> 8`,
+     * a single byte or an earlier string of the seed, followed by the byte
+     * `keys[n] & 0xff`. The default seed is empty.
+*/
+struct Seed
+{
+    const std::uint32_t *keys;
+    std::size_t size;
+
+    /// Returns the prefix code of string `256 + n`.
+    std::uint32_t prefix(std::size_t n) const
+    {
+        return keys[n] >> 8;
+    }
+
+    /// Returns the last byte of string `256 + n`.
+    char byte(std::size_t n) const
+    {
+        return static_cast<char> (keys[n] & 0xff);
+    }
+};
+
+/// The seed of dictionaries that start from the single bytes alone.
+const Seed no_seed {nullptr, 0};
+
+
+/**
+     * Memory for the nodes of a node-based container, which all have the
+     * same size, recycled rather than freed.
+     *
+     * Nodes are carved out of chunks, and a node the container frees goes
+     * onto a list that the next one is taken from. The chunks are only freed
+     * with the arena, so a container that is cleared and filled again as
+     * often as a dictionary allocates nothing once it has been full once.
+*/
+class NodeArena
+{
+public:
+
+    NodeArena():
+        node_size_ {0},
+        free_ {nullptr},
+        next_ {nullptr},
+        left_ {0}
+    {
+    }
+
+    NodeArena(const NodeArena &) = delete;
+    NodeArena &operator=(const NodeArena &) = delete;
+
+    /// Returns memory for a node of `size` bytes, the size of every node of the arena.
+    void *allocate(std::size_t size)
+    {
+        if (free_ != nullptr)
+        {
+            Free * const node {free_};
+
+            free_ = node->next;
+            return node;
+        }
+
+        if (left_ == 0)
+        {
+            node_size_ = node_size(size);
+            chunks_.emplace_back(new Chunk[nodes_per_chunk * node_size_ / sizeof (Chunk)]);
+            next_ = reinterpret_cast<char *> (chunks_.back().get());
+            left_ = nodes_per_chunk;
+        }
+
+        void * const node {next_};
+
+        next_ += node_size_;
+        --left_;
+        return node;
+    }
+
+    /// Takes the node at `p` back.
+    void deallocate(void *p)
+    {
+        Free * const node {static_cast<Free *> (p)};
+
+        node->next = free_;
+        free_ = node;
+    }
+
+    /// Returns the bytes a node of `size` bytes takes, rounded up so that every node is as aligned as the chunk.
+    static std::size_t node_size(std::size_t size)
+    {
+        return std::max(sizeof (Free), (size + alignof (std::max_align_t) - 1)
+                                       / alignof (std::max_align_t) * alignof (std::max_align_t));
+    }
+
+private:
+
+    struct Free
+    {
+        Free *next;
+    };
+
+    /// Unit of the chunks, for their alignment.
+    struct alignas(alignof (std::max_align_t)) Chunk
+    {
+        char bytes[alignof (std::max_align_t)];
+    };
+
+    static const std::size_t nodes_per_chunk {4096};
+
+    std::vector<std::unique_ptr<Chunk[]>> chunks_;
+    std::size_t node_size_;
+    Free *free_;            ///< nodes freed, to be allocated first
+    char *next_;            ///< first node of the last chunk never allocated
+    std::size_t left_;      ///< number of nodes left at `next_`
+};
+
+
+/// Allocator of the nodes of a container from a `NodeArena`; arrays come from `std::allocator`.
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    NodeArena *arena;
+
+    explicit ArenaAllocator(NodeArena *a):
+        arena {a}
+    {
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other):
+        arena {other.arena}
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        return n == 1 ? static_cast<T *> (arena->allocate(sizeof (T))) : std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        if (n == 1)
+            arena->deallocate(p);
+        else
+            std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+    return a.arena != b.arena;
+}
+
+
+/**
+     * Compressor dictionary backed by `std::map`.
+     *
+     * Every lookup walks a red-black tree and every new code takes a node,
+     * from an arena that keeps the nodes of the strings of the previous
+     * dictionaries. Kept as the reference implementation to compare
+     * `FlatDictionary` against.
+*/
+template <unsigned int Bits>
+class MapDictionary
+{
+public:
+
+    using CodeType = typename CodeTraits<Bits>::CodeType;
+
+    /// The dictionary is reset once full.
+    static const bool recycles {false};
+
+    /// @param seed    strings to start from after the single bytes, alive as long as the dictionary
+    explicit MapDictionary(const Seed &seed = no_seed):
+        dictionary_(std::less<Key>(), Allocator(&arena_))
+    {
+        reseed(seed);
+    }
+
+    MapDictionary(const MapDictionary &) = delete;
+    MapDictionary &operator=(const MapDictionary &) = delete;
+
+    /// Makes `seed` the strings to start from, and resets the dictionary.
+    void reseed(const Seed &seed)
+    {
+        seed_ = seed;
+        reset();
+    }
+
+    /// Resets the dictionary to its initial contents.
+    void reset()
+    {
+        dictionary_.clear();
+
+        const long int minc = std::numeric_limits<char>::min();
+        const long int maxc = std::numeric_limits<char>::max();
+
+        for (long int c = minc; c <= maxc; ++c)
+        {
+            // to prevent Undefined Behavior, resulting from reading and modifying
+            // the dictionary object at the same time
+            const CodeType dictionary_size = size();
+
+            dictionary_[{CodeTraits<Bits>::dms, static_cast<char> (c)}] = dictionary_size;
+        }
+
+        for (std::size_t n = 0; n < seed_.size; ++n)
+        {
+            const CodeType dictionary_size = size();
+
+            dictionary_[{static_cast<CodeType> (seed_.prefix(n)), seed_.byte(n)}] = dictionary_size;
+        }
+    }
+
+    /// Returns the number of codes in the dictionary.
+    CodeType size() const
+    {
+        return static_cast<CodeType> (dictionary_.size());
+    }
+
+    /**
+     * Looks up the string `i` + `c`.
+     *
+     * @param i    code of the prefix, or `dms` for the empty string
+     * @param c    byte appended to the prefix
+     * @return     code of the string, or `dms` if it was not found,
+     *             in which case it has been added as the next code
+    */
+    CodeType search_and_insert(CodeType i, char c)
+    {
+        const CodeType dictionary_size = size();
+        const auto result = dictionary_.insert({{i, c}, dictionary_size});
+
+        return result.second ? CodeTraits<Bits>::dms : result.first->second;
+    }
+
+    /// Returns the code of the string `i` + `c`, or `dms` if it is not in the dictionary.
+    CodeType search(CodeType i, char c) const
+    {
+        const auto found = dictionary_.find({i, c});
+
+        return found == dictionary_.end() ? CodeTraits<Bits>::dms : found->second;
+    }
+
+    /// Returns the code of the single-byte string `c`.
+    CodeType search_initials(char c) const
+    {
+        return dictionary_.at({CodeTraits<Bits>::dms, c});
+    }
+
+    /**
+     * Returns the bytes of storage of a full dictionary, one node per code,
+     * each a value and the three links and color of a red-black tree node.
+    */
+    static std::size_t storage()
+    {
+        return (std::size_t {CodeTraits<Bits>::dms} + 1)
+               * NodeArena::node_size(4 * sizeof (void *) + sizeof (std::pair<const Key, CodeType>));
+    }
+
+private:
+
+    using Key = std::pair<CodeType, char>;
+    using Allocator = ArenaAllocator<std::pair<const Key, CodeType>>;
+
+    NodeArena arena_;   ///< declared first, to outlive `dictionary_`
+    std::map<Key, CodeType, std::less<Key>, Allocator> dictionary_;
+    Seed seed_;
+};
+
+
+/**
+     * Compressor dictionary backed by a flat open-addressing hash table.
+     *
+     * All slots are allocated once, up front, at twice the maximum number of
+     * codes so that linear probing stays short. A slot packs the (prefix, byte)
+     * key into 32 bits, so a lookup and the following insert share one probe
+     * sequence.
+     *
+     * Slots are tagged with the generation they were written in, and a slot
+     * from an older generation counts as empty. Resetting the dictionary is
+     * therefore a counter bump; the table is only wiped when the counter wraps.
+     * The tag shares a 32-bit word with the code, so it has `32 - Bits` bits.
+     * The 256 single-byte strings are never stored, their codes are computed.
+     * The strings of a seed land in the same slots after every reset, so
+     * those are found once and a reset writes the seed straight into them.
+*/
+template <unsigned int Bits>
+class FlatDictionary
+{
+public:
+
+    using CodeType = typename CodeTraits<Bits>::CodeType;
+
+    /// The dictionary is reset once full.
+    static const bool recycles {false};
+
+    /// @param seed    strings to start from after the single bytes, alive as long as the dictionary
+    explicit FlatDictionary(const Seed &seed = no_seed):
+        slots_(table_size, Slot {0, 0}),
+        generation_ {0},
+        seed_(no_seed)
+    {
+        reseed(seed);
+    }
+
+    /// Makes `seed` the strings to start from, and resets the dictionary.
+    void reseed(const Seed &seed)
+    {
+        seed_ = seed;
+        seed_slots_.clear();
+        reset();
+
+        for (std::size_t n = 0; n < seed.size; ++n)
+        {
+            std::uint32_t h {hash(seed.keys[n])};
+
+            while ((slots_[h].value >> Bits) == generation_)
+                h = (h + 1) & (table_size - 1);
+
+            slots_[h] = Slot {seed.keys[n], generation_ << Bits | size_++};
+            seed_slots_.push_back(h);
+        }
+    }
+
+    /// Resets the dictionary to its initial contents.
+    void reset()
+    {
+        if (++generation_ == generation_limit)
+        {
+            std::fill(slots_.begin(), slots_.end(), Slot {0, 0});
+            generation_ = 1;
+        }
+
+        size_ = 256;
+
+        for (std::size_t n = 0; n < seed_slots_.size(); ++n)
+            slots_[seed_slots_[n]] = Slot {seed_.keys[n], generation_ << Bits | size_++};
+    }
+
+    /// Returns the number of codes in the dictionary.
+    CodeType size() const
+    {
+        return size_;
+    }
+
+    /**
+     * Looks up the string `i` + `c`.
+     *
+     * @param i    code of the prefix, or `dms` for the empty string
+     * @param c    byte appended to the prefix
+     * @return     code of the string, or `dms` if it was not found,
+     *             in which case it has been added as the next code
+    */
+    CodeType search_and_insert(CodeType i, char c)
+    {
+        if (i == CodeTraits<Bits>::dms)
+            return static_cast<CodeType> (initial_code(c));
+
+        const std::uint32_t key {make_key(i, c)};
+        std::uint32_t h {hash(key)};
+
+        while ((slots_[h].value >> Bits) == generation_)
+        {
+            if (slots_[h].key == key)
+                return static_cast<CodeType> (slots_[h].value & CodeTraits<Bits>::dms);
+
+            h = (h + 1) & (table_size - 1);
+        }
+
+        slots_[h] = Slot {key, generation_ << Bits | size_++};
+        return CodeTraits<Bits>::dms;
+    }
+
+    /// Returns the code of the string `i` + `c`, or `dms` if it is not in the dictionary.
+    CodeType search(CodeType i, char c) const
+    {
+        if (i == CodeTraits<Bits>::dms)
+            return static_cast<CodeType> (initial_code(c));
+
+        const std::uint32_t key {make_key(i, c)};
+
+        for (std::uint32_t h = hash(key); (slots_[h].value >> Bits) == generation_; h = (h + 1) & (table_size - 1))
+            if (slots_[h].key == key)
+                return static_cast<CodeType> (slots_[h].value & CodeTraits<Bits>::dms);
+
+        return CodeTraits<Bits>::dms;
+    }
+
+    /// Returns the code of the single-byte string `c`.
+    CodeType search_initials(char c) const
+    {
+        return static_cast<CodeType> (initial_code(c));
+    }
+
+    /// Returns the bytes of storage of the dictionary, those of the strings of the largest seed included.
+    static std::size_t storage()
+    {
+        return table_size * sizeof (Slot) + CodeTraits<Bits>::dms / 2 * sizeof (std::uint32_t);
+    }
+
+private:
+
+    struct Slot
+    {
+        std::uint32_t key;
+        std::uint32_t value; ///< generation in the high bits, code in the low `Bits` bits
+    };
+
+    /// Number of slots, a power of two at least twice `dms`.
+    static const unsigned int table_bits {Bits + 1};
+    static const std::uint32_t table_size {std::uint32_t {1} << table_bits};
+
+    /// Generations run from 1 to one below this; 0 marks slots that were never written.
+    static const std::uint32_t generation_limit {static_cast<std::uint32_t> ((std::uint64_t {1} << (32 - Bits)) - 1)};
+
+    static std::uint32_t make_key(CodeType i, char c)
+    {
+        return static_cast<std::uint32_t> (i) << 8 | static_cast<unsigned char> (c);
+    }
+
+    /// Fibonacci hashing: the top bits of the product are the best mixed.
+    static std::uint32_t hash(std::uint32_t key)
+    {
+        return (key * 2654435761u) >> (32 - table_bits);
+    }
+
+    std::vector<Slot> slots_;
+    std::uint32_t generation_;
+    CodeType size_;
+    Seed seed_;
+    std::vector<std::uint32_t> seed_slots_;     ///< slot of every string of the seed
+};
+
+
+/**
+     * The leaves of a dictionary, the strings no other string extends, in the
+     * order they became leaves.
+     *
+     * A string loses its leaf status as soon as it is extended, and every
+     * code written extends its string, so the front of the queue is the leaf
+     * that has gone unused longest. Single-byte strings are never leaves here,
+     * they are never replaced.
+     *
+     * The encoder and the decoder keep one each, and update them in the same
+     * order, so that they pick the same leaves to replace.
+*/
+template <unsigned int Bits>
+class LeafQueue
+{
+public:
+
+    using CodeType = typename CodeTraits<Bits>::CodeType;
+
+    LeafQueue():
+        nodes_(CodeTraits<Bits>::dms + 1)
+    {
+        reset();
+    }
+
+    /// Forgets all leaves.
+    void reset()
+    {
+        std::fill(nodes_.begin(), nodes_.end(), Node {none, none, 0});
+    }
+
+    /// Adds the new string `k`, which extends the string `prefix`.
+    void add(CodeType k, CodeType prefix)
+    {
+        if (nodes_[prefix].children++ == 0 && prefix >= 256)
+            unlink(prefix);
+
+        link(k);
+    }
+
+    /// Removes the leaf `k`, whose string extended the string `prefix`.
+    void remove(CodeType k, CodeType prefix)
+    {
+        unlink(k);
+
+        if (--nodes_[prefix].children == 0 && prefix >= 256)
+            link(prefix);
+    }
+
+    /// Returns the oldest leaf other than `except`, or `dms` if there is none.
+    CodeType oldest(CodeType except) const
+    {
+        const CodeType front {nodes_[none].next};
+
+        return front != except ? front : nodes_[front].next;
+    }
+
+    /// Returns the bytes of storage of a queue.
+    static std::size_t storage()
+    {
+        return (std::size_t {CodeTraits<Bits>::dms} + 1) * sizeof (Node);
+    }
+
+private:
+
+    /// The links of a code, kept together so that updating them touches a single cache line.
+    struct Node
+    {
+        CodeType previous;
+        CodeType next;
+        CodeType children;  ///< number of strings extending this one
+    };
+
+    /**
+     * Node `dms` heads the list, which is circular: its `next` is the oldest
+     * leaf and its `previous` the newest, or itself when there are none.
+    */
+    static const CodeType none {CodeTraits<Bits>::dms};
+
+    void link(CodeType k)
+    {
+        const CodeType back {nodes_[none].previous};
+
+        nodes_[k].previous = back;
+        nodes_[k].next = none;
+        nodes_[back].next = k;
+        nodes_[none].previous = k;
+    }
+
+    void unlink(CodeType k)
+    {
+        const Node &node = nodes_[k];
+
+        nodes_[node.previous].next = node.next;
+        nodes_[node.next].previous = node.previous;
+    }
+
+    std::vector<Node> nodes_;
+};
+
+
+/**
+     * Compressor dictionary that, once full, replaces its oldest leaf with
+     * every new string instead of being reset (LZW-AP).
+     *
+     * Like `FlatDictionary`, but replacing strings means removing them from
+     * the hash table, so slots are freed by shifting the rest of their probe
+     * sequence back rather than tagged with generations.
+*/
+template <unsigned int Bits>
+class RecyclingDictionary
+{
+public:
+
+    using CodeType = typename CodeTraits<Bits>::CodeType;
+
+    /// The dictionary never needs a reset.
+    static const bool recycles {true};
+
+    /// @param seed    strings to start from after the single bytes, alive as long as the dictionary
+    explicit RecyclingDictionary(const Seed &seed = no_seed):
+        slots_(table_size),
+        keys_(CodeTraits<Bits>::dms),
+        seed_(seed)
+    {
+        reset();
+    }
+
+    /// Makes `seed` the strings to start from, and resets the dictionary.
+    void reseed(const Seed &seed)
+    {
+        seed_ = seed;
+        reset();
+    }
+
+    /// Resets the dictionary to its initial contents.
+    void reset()
+    {
+        std::fill(slots_.begin(), slots_.end(), Slot {empty_key, 0});
+        leaves_.reset();
+        size_ = 256;
+
+        // the strings of the seed are leaves like any other, in the order the decoder adds them too
+        for (std::size_t n = 0; n < seed_.size; ++n)
+            search_and_insert(static_cast<CodeType> (seed_.prefix(n)), seed_.byte(n));
+    }
+
+    /// Returns the number of codes in the dictionary, which stops growing at `dms`.
+    CodeType size() const
+    {
+        return size_;
+    }
+
+    /**
+     * Looks up the string `i` + `c`.
+     *
+     * @param i    code of the prefix, or `dms` for the empty string
+     * @param c    byte appended to the prefix
+     * @return     code of the string, or `dms` if it was not found, in which
+     *             case it has been added as the next code or in place of the
+     *             oldest leaf other than `i`
+    */
+    CodeType search_and_insert(CodeType i, char c)
+    {
+        if (i == CodeTraits<Bits>::dms)
+            return static_cast<CodeType> (initial_code(c));
+
+        const std::uint32_t key {make_key(i, c)};
+        std::uint32_t h {hash(key)};
+
+        for (; slots_[h].key != empty_key; h = (h + 1) & (table_size - 1))
+            if (slots_[h].key == key)
+                return slots_[h].code;
+
+        CodeType k {size_};
+
+        if (size_ < CodeTraits<Bits>::dms)
+            ++size_;
+        else
+        {
+            k = leaves_.oldest(i);
+
+            if (k == CodeTraits<Bits>::dms)
+                return CodeTraits<Bits>::dms;
+
+            leaves_.remove(k, static_cast<CodeType> (keys_[k] >> 8));
+            erase(keys_[k]);
+
+            // erasing may have moved the end of the probe sequence
+            for (h = hash(key); slots_[h].key != empty_key; h = (h + 1) & (table_size - 1))
+                ;
+        }
+
+        slots_[h] = Slot {key, k};
+        keys_[k] = key;
+        leaves_.add(k, i);
+        return CodeTraits<Bits>::dms;
+    }
+
+    /// Looks up the string `i` + `c` without adding it; returns `dms` if it was not found.
+    CodeType search(CodeType i, char c) const
+    {
+        if (i == CodeTraits<Bits>::dms)
+            return static_cast<CodeType> (initial_code(c));
+
+        const std::uint32_t key {make_key(i, c)};
+
+        for (std::uint32_t h = hash(key); slots_[h].key != empty_key; h = (h + 1) & (table_size - 1))
+            if (slots_[h].key == key)
+                return slots_[h].code;
+
+        return CodeTraits<Bits>::dms;
+    }
+
+    /// Returns the code of the single-byte string `c`.
+    CodeType search_initials(char c) const
+    {
+        return static_cast<CodeType> (initial_code(c));
+    }
+
+    /// Returns the bytes of storage of the dictionary, its leaves included.
+    static std::size_t storage()
+    {
+        return table_size * sizeof (Slot) + CodeTraits<Bits>::dms * sizeof (std::uint32_t)
+               + LeafQueue<Bits>::storage();
+    }
+
+private:
+
+    struct Slot
+    {
+        std::uint32_t key;
+        CodeType code;
+    };
+
+    /// Number of slots, a power of two at least twice `dms`.
+    static const unsigned int table_bits {Bits + 1};
+    static const std::uint32_t table_size {std::uint32_t {1} << table_bits};
+
+    /// Keys are below 2^32 - 256, since prefixes are below `dms`.
+    static const std::uint32_t empty_key {0xffffffff};
+
+    static std::uint32_t make_key(CodeType i, char c)
+    {
+        return static_cast<std::uint32_t> (i) << 8 | static_cast<unsigned char> (c);
+    }
+
+    static std::uint32_t hash(std::uint32_t key)
+    {
+        return (key * 2654435761u) >> (32 - table_bits);
+    }
+
+    /// Removes `key`, which must be in the table, keeping every other key reachable.
+    void erase(std::uint32_t key)
+    {
+        const std::uint32_t mask {table_size - 1};
+        std::uint32_t hole {hash(key)};
+
+        while (slots_[hole].key != key)
+            hole = (hole + 1) & mask;
+
+        for (std::uint32_t j = (hole + 1) & mask; slots_[j].key != empty_key; j = (j + 1) & mask)
+        {
+            // the key at `j` may fill the hole unless its home is after the hole
+            const std::uint32_t home {hash(slots_[j].key)};
+
+            if (((j - home) & mask) >= ((j - hole) & mask))
+            {
+                slots_[hole] = slots_[j];
+                hole = j;
+            }
+        }
+
+        slots_[hole].key = empty_key;
+    }
+
+    std::vector<Slot> slots_;
+    std::vector<std::uint32_t> keys_;   ///< key of every code, to find it again when it is replaced
+    LeafQueue<Bits> leaves_;
+    CodeType size_;
+    Seed seed_;
+};
+
+
+/**
+     * Decompressor dictionary: for every code, its prefix code, first byte,
+     * length and last few bytes, indexed by code.
+     *
+     * Storage for `dms` entries is allocated once and the 256 single-byte
+     * entries, and those of a seed, are written once, in the constructor.
+     * Resetting the dictionary only forgets the codes above them, so it does
+     * not touch memory at all.
+     *
+     * Each entry is 16 bytes, aligned so that it never straddles a cache line,
+     * and holds up to `inline_size` bytes of its string: the bytes after the
+     * longest prefix whose length is a multiple of `inline_size`, which it
+     * links to. Knowing the length of a string up front lets `copy_string()`
+     * write it back to front straight into its final place, a piece of up to
+     * `inline_size` bytes per entry visited rather than a byte per prefix.
+*/
+template <unsigned int Bits>
+class DecoderDictionary
+{
+public:
+
+    using CodeType = typename CodeTraits<Bits>::CodeType;
+
+    /// @param seed    strings to start from after the single bytes
+    explicit DecoderDictionary(const Seed &seed = no_seed):
+        entries_(CodeTraits<Bits>::dms),
+        base_ {256}
+    {
+        const long int minc = std::numeric_limits<char>::min();
+        const long int maxc = std::numeric_limits<char>::max();
+
+        for (long int c = minc; c <= maxc; ++c)
+        {
+            Entry &e = entries_[initial_code(static_cast<char> (c))];
+
+            e.prefix = CodeTraits<Bits>::dms;
+            e.ancestor = CodeTraits<Bits>::dms;
+            e.length = 1;
+            e.first = static_cast<char> (c);
+            e.tail[0] = static_cast<char> (c);
+        }
+
+        reseed(seed);
+    }
+
+    /// Makes `seed` the strings to start from, and resets the dictionary.
+    void reseed(const Seed &seed)
+    {
+        base_ = 256;
+        reset();
+
+        for (std::size_t n = 0; n < seed.size; ++n)
+            push_back(static_cast<CodeType> (seed.prefix(n)), seed.byte(n));
+
+        base_ = size_;
+    }
+
+    /// Resets the dictionary to its initial contents.
+    void reset()
+    {
+        size_ = base_;
+        deferred_ = CodeTraits<Bits>::dms;
+    }
+
+    /// Returns the number of codes in the dictionary.
+    CodeType size() const
+    {
+        return size_;
+    }
+
+    /**
+     * Adds the string `i` + `c` as the next code.
+     *
+     * The first code added after a reset may be built on a code from before
+     * the reset, which means a code that does not exist yet. Its first byte
+     * and length are filled in once that code is added; until then the entry
+     * is not `valid()`.
+     *
+     * @param i    code of the prefix
+     * @param c    byte appended to the prefix
+    */
+    void push_back(CodeType i, char c)
+    {
+        Entry &e = entries_[size_];
+
+        if (i < size_)
+            fill(e, i, c);
+        else
+        {
+            e.prefix = i;
+            e.length = 0;
+            deferred_ = size_;
+            deferred_byte_ = c;
+        }
+
+        ++size_;
+
+        if (deferred_ != CodeTraits<Bits>::dms && entries_[deferred_].prefix == size_ - 1)
+        {
+            Entry &d = entries_[deferred_];
+
+            // a code built on itself stands for its last byte alone
+            if (deferred_ == size_ - 1)
+            {
+                d.ancestor = CodeTraits<Bits>::dms;
+                d.length = 1;
+                d.tail[0] = deferred_byte_;
+            }
+            else
+                fill(d, size_ - 1, deferred_byte_);
+
+            deferred_ = CodeTraits<Bits>::dms;
+        }
+    }
+
+    /**
+     * Replaces the string of code `k`, which must be below `size()`, with
+     * the string `i` + `c`.
+     *
+     * @param k    code to be reused, which no other code may extend
+     * @param i    code of the prefix, which must be valid
+     * @param c    byte appended to the prefix
+    */
+    void replace(CodeType k, CodeType i, char c)
+    {
+        fill(entries_[k], i, c);
+    }
+
+    /// Returns whether the string of code `k`, which must be below `size()`, is known.
+    bool valid(CodeType k) const
+    {
+        return entries_[k].length != 0;
+    }
+
+    /// Returns whether the strings of all the codes below `size()` are known, no code waiting for its prefix.
+    bool complete() const
+    {
+        return deferred_ == CodeTraits<Bits>::dms;
+    }
+
+    /// Returns the code of the prefix of the string of code `k`, or `dms` for a single byte.
+    CodeType prefix(CodeType k) const
+    {
+        return entries_[k].prefix;
+    }
+
+    /// Returns the first byte of the string of code `k`.
+    char first(CodeType k) const
+    {
+        return entries_[k].first;
+    }
+
+    /// Returns the length of the string of code `k`.
+    CodeType length(CodeType k) const
+    {
+        return entries_[k].length;
+    }
+
+    /**
+     * Writes the string of code `k` to the `length(k)` bytes ending at `last`.
+     *
+     * @param k            valid code
+     * @param [out] last   one past the last byte to be written
+    */
+    void copy_string(CodeType k, char *last) const
+    {
+        for (std::size_t length = entries_[k].length; length != 0; )
+        {
+            const Entry &e = entries_[k];
+            const std::size_t n {tail_length(length)};
+
+            last -= n;
+            std::memcpy(last, e.tail, n);
+            length -= n;
+            k = e.ancestor;
+        }
+    }
+
+private:
+
+    /// Bytes of its string held by an entry, what is left of 16 bytes.
+    static const std::size_t inline_size {16 - 3 * sizeof (CodeType) - 1};
+
+    struct alignas(16) Entry
+    {
+        CodeType prefix;
+        CodeType ancestor;          ///< code of the string without `tail`, or `dms` if there is none
+        CodeType length;
+        char first;
+        char tail[inline_size];     ///< the last `tail_length(length)` bytes of the string
+    };
+
+    /// Returns how many bytes of a string of `length` bytes its entry holds.
+    static std::size_t tail_length(std::size_t length)
+    {
+        return (length - 1) % inline_size + 1;
+    }
+
+    /// Makes `e` the entry of the string `i` + `c`, where `i` is valid.
+    void fill(Entry &e, CodeType i, char c) const
+    {
+        const Entry &p = entries_[i];
+        const std::size_t n {tail_length(p.length)};
+
+        e.prefix = i;
+        e.length = static_cast<CodeType> (p.length + 1);
+        e.first = p.first;
+
+        if (n == inline_size)
+        {
+            e.ancestor = i;
+            e.tail[0] = c;
+        }
+        else
+        {
+            e.ancestor = p.ancestor;
+            std::memcpy(e.tail, p.tail, n);
+            e.tail[n] = c;
+        }
+    }
+
+    std::vector<Entry> entries_;
+    CodeType base_;         ///< number of codes after a reset, those of the seed included
+    CodeType size_;
+    CodeType deferred_;     ///< code waiting for its prefix to be added, or `dms`
+    char deferred_byte_;    ///< last byte of the string of `deferred_`
+};
+
+#endif // MEGALZW_DICTIONARY_H
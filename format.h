@@ -0,0 +1,225 @@
+#ifndef MEGALZW_FORMAT_H
+#define MEGALZW_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+
+
+/**
+     * Layout of compressed files. All integers are little-endian.
+     *
+     * Version 0 files have no header at all: they are the fixed-width codes,
+     * 2 bytes each, that the first releases wrote. Its first code is always
+     * below 256, so its first two bytes can never spell the magic number.
+     *
+     * Every later version starts with:
+     *
+     *      offset  size  field
+     *      0       4     magic number "MLZW"
+     *      4       1     version
+     *      5       1     maximum code width, in bits, in the low 5 bits, and flags:
+     *                      0x80  the codes include a clear code, see `flag_clear_code`
+     *                      0x40  a full dictionary recycles its leaves, see `flag_recycle`
+     *                      0x20  the data was transformed by `bmp_filter()`, see `flag_bmp_filter`
+     *
+     * Version 1 continues with a single stream of variable-width codes.
+     *
+     * Version 2 splits the input into blocks compressed independently of each
+     * other, and continues with:
+     *
+     *      6       4     block size: input bytes per block, the last one may be shorter
+     *      10            the blocks, each one made of
+     *                      4     original size
+     *                      4     compressed size
+     *                      ...   a stream of variable-width codes, as in version 1
+     *                    and then 8 zero bytes
+     *                    the block index:
+     *                      8     number of blocks
+     *                      ...   for each block, `index_entry_size` bytes:
+     *                            8 offset of its header, 4 compressed size, 4 original size
+     *                    the trailer, the last `trailer_size` bytes of the file:
+     *                      8     offset of the block index
+     *                      4     magic number "MLZI"
+     *
+     * The headers in front of the blocks let a decoder read a version 2 file
+     * front to back; the index lets it find any block without doing so.
+     *
+     * A block whose compressed size, in its header and its index entry, has
+     * the high bit `stored_block` set is stored: the rest of the field is
+     * its original size, and its bytes are the original data as it is.
+     *
+     * Version 3 is version 2 with CRC-32C checksums, see crc32c.h, of the
+     * data the blocks decode to:
+     *
+     *      - every block header has a third field, 4 checksum of the block,
+     *        and the blocks end with 12 zero bytes
+     *      - every index entry ends with 4 checksum of the block
+     *      - the trailer starts with 4 checksum of all the blocks together
+     *
+     * Version 4 is version 1 with a seed dictionary, see seed_dictionary.h,
+     * which the dictionary starts from every time it starts over:
+     *
+     *      6       4     ID of the seed dictionary
+     *      10            a stream of variable-width codes, as in version 1
+     *
+     * Seed dictionaries are stored in files of their own:
+     *
+     *      0       4     magic number "MLZD"
+     *      4       1     seed dictionary version, 1
+     *      5       4     number of strings
+     *      9             for each string, 4 bytes: the code of its prefix
+     *                    in the high 24 bits, its last byte in the low 8
+     *                    and then 4 ID, the CRC-32C of the strings
+     *
+     * Archives, see archive.h, hold many files compressed one by one:
+     *
+     *      0       4     magic number "MLZA"
+     *      4       1     archive version, 1
+     *      5             the members, each a compressed file of its own, as `compress()` writes them
+     *                    the file table:
+     *                      8     number of members
+     *                      ...   for each member, `archive_entry_size` bytes:
+     *                            8 offset, 8 compressed size, 8 original size, 2 name size,
+     *                            and then the name
+     *                    the trailer, the last `trailer_size` bytes of the file:
+     *                      8     offset of the file table
+     *                      4     magic number "MLZT"
+*/
+namespace format {
+
+    const char magic[4] {'M', 'L', 'Z', 'W'};
+    const char index_magic[4] {'M', 'L', 'Z', 'I'};
+    const char archive_magic[4] {'M', 'L', 'Z', 'A'};
+    const char archive_table_magic[4] {'M', 'L', 'Z', 'T'};
+    const char seed_magic[4] {'M', 'L', 'Z', 'D'};
+
+    /// Size of the header shared by all versions except 0.
+    const std::size_t header_size {6};
+
+    /// Version 1: a single stream of variable-width codes, see `CodeWriter`.
+    const std::uint8_t version_stream {1};
+
+    /// Version 2: independently compressed blocks with a block index.
+    const std::uint8_t version_blocks {2};
+
+    /// Version 3: version 2 with checksums.
+    const std::uint8_t version_checked_blocks {3};
+
+    /// Version 4: version 1 with a seed dictionary.
+    const std::uint8_t version_seeded_stream {4};
+
+    /// Size of the ID of the seed dictionary after the header of version 4 files.
+    const std::size_t seed_id_size {4};
+
+    /// Bits of the width byte holding the maximum code width.
+    const std::uint8_t width_mask {0x1f};
+
+    /**
+     * The largest code, all ones at the maximum width, clears the dictionary.
+     *
+     * A full dictionary is then kept as it is, rather than reset, until the
+     * encoder sends the clear code; see `CodeEncoder`.
+    */
+    const std::uint8_t flag_clear_code {0x80};
+
+    /**
+     * A full dictionary replaces its oldest leaf with every new string rather
+     * than being reset; see `LeafQueue`. Cannot be combined with a clear code.
+    */
+    const std::uint8_t flag_recycle {0x40};
+
+    /**
+     * The codes are those of the data transformed by `bmp_filter()`, which
+     * `bmp_unfilter()` undoes once it is decompressed.
+    */
+    const std::uint8_t flag_bmp_filter {0x20};
+
+    /// Flags known to this version of the decoder.
+    const std::uint8_t known_flags {flag_clear_code | flag_recycle | flag_bmp_filter};
+
+    const std::size_t block_header_size {8};
+
+    /**
+     * Set in the compressed size of a block that is stored rather than
+     * compressed, because its codes would not be smaller than its data.
+     * Coded blocks are smaller than the largest block size, so never have it.
+    */
+    const std::uint32_t stored_block {0x80000000};
+
+    const std::size_t index_entry_size {16};
+    const std::size_t trailer_size {12};
+
+    /// Sizes of the same in version 3, which adds a checksum to each.
+    const std::size_t checksum_size {4};
+
+    const std::uint8_t archive_version {1};
+    const std::size_t archive_header_size {5};
+    const std::size_t archive_entry_size {26};
+
+    const std::uint8_t seed_version {1};
+    const std::size_t seed_header_size {9};
+
+    /// Returns whether files of `version` are made of blocks.
+    inline bool has_blocks(unsigned int version)
+    {
+        return version == version_blocks || version == version_checked_blocks;
+    }
+
+    /// Returns whether the `header` of a version 1 or later file has the `flag_bmp_filter` flag.
+    inline bool has_bmp_filter(const char *header)
+    {
+        return (static_cast<std::uint8_t> (header[5]) & flag_bmp_filter) != 0;
+    }
+
+    /// Returns whether the `header_size` bytes at `header` start with the magic number.
+    inline bool has_magic(const char *header)
+    {
+        return std::memcmp(header, magic, sizeof magic) == 0;
+    }
+
+    inline void put_u16(char *p, std::uint16_t v)
+    {
+        p[0] = static_cast<char> (v);
+        p[1] = static_cast<char> (v >> 8);
+    }
+
+    inline void put_u32(char *p, std::uint32_t v)
+    {
+        for (int b = 0; b < 4; ++b)
+            p[b] = static_cast<char> (v >> (8 * b));
+    }
+
+    inline void put_u64(char *p, std::uint64_t v)
+    {
+        for (int b = 0; b < 8; ++b)
+            p[b] = static_cast<char> (v >> (8 * b));
+    }
+
+    inline std::uint16_t get_u16(const char *p)
+    {
+        return static_cast<std::uint16_t> (static_cast<unsigned char> (p[0]) | static_cast<unsigned char> (p[1]) << 8);
+    }
+
+    inline std::uint32_t get_u32(const char *p)
+    {
+        std::uint32_t v {0};
+
+        for (int b = 0; b < 4; ++b)
+            v |= static_cast<std::uint32_t> (static_cast<unsigned char> (p[b])) << (8 * b);
+
+        return v;
+    }
+
+    inline std::uint64_t get_u64(const char *p)
+    {
+        std::uint64_t v {0};
+
+        for (int b = 0; b < 8; ++b)
+            v |= static_cast<std::uint64_t> (static_cast<unsigned char> (p[b])) << (8 * b);
+
+        return v;
+    }
+
+} // namespace format
+
+#endif // MEGALZW_FORMAT_H
@@ -0,0 +1,689 @@
+#include "lzw.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <streambuf>
+
+#include "bitio.h"
+#include "blocks.h"
+#include "bmp_filter.h"
+#include "codec.h"
+#include "format.h"
+#include "memory_budget.h"
+#include "seed_dictionary.h"
+#include "timed_streambuf.h"
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+     * Fills in `stats`, if any.
+     *
+     * @param [out] stats  where to report, or null
+     * @param counts       work done by the codec loops
+     * @param bytes_in     bytes read
+     * @param bytes_out    bytes written
+     * @param io_seconds   time spent reading and writing
+     * @param start        when the call started
+     * @param counted      whether `Stats::progress` was advanced as the input was read, rather than all at once here
+*/
+void report(Stats *stats, const CodeCounts &counts, std::uint64_t bytes_in, std::uint64_t bytes_out,
+            double io_seconds, Clock::time_point start, bool counted = false)
+{
+    if (stats == nullptr)
+        return;
+
+    const double seconds {std::chrono::duration<double>(Clock::now() - start).count()};
+
+    stats->bytes_in = bytes_in;
+    stats->bytes_out = bytes_out;
+    stats->codes = counts.codes;
+    stats->resets = counts.resets;
+    stats->io_seconds = io_seconds;
+    stats->codec_seconds = std::max(0.0, seconds - io_seconds);
+    stats->peak_memory = peak_memory();
+
+    if (stats->progress != nullptr)
+    {
+        if (!counted)
+            stats->progress->advance(bytes_in);
+
+        stats->progress->finish();
+    }
+}
+
+
+/**
+     * Runs `f(is, os)`, which returns `CodeCounts`, and fills in `stats`, if any.
+     *
+     * To count and time the I/O, and advance `Stats::progress` as the input
+     * is read, `f` is given streams over `TimedStreambuf`s forwarding to
+     * those of `is` and `os`; without `stats`, it is given `is` and `os`
+     * themselves.
+*/
+template <typename F>
+void run_on_streams(std::istream &is, std::ostream &os, Stats *stats, F f)
+{
+    if (stats == nullptr)
+    {
+        f(is, os);
+        return;
+    }
+
+    const Clock::time_point start {Clock::now()};
+
+    TimedStreambuf input_buffer(*is.rdbuf(), stats->progress);
+    TimedStreambuf output_buffer(*os.rdbuf());
+    std::istream input(&input_buffer);
+    std::ostream output(&output_buffer);
+
+    input.exceptions(is.exceptions());
+    output.exceptions(os.exceptions());
+
+    const CodeCounts counts {f(input, output)};
+
+    if (input.bad())
+        is.setstate(std::ios_base::badbit);
+
+    if (output.bad())
+        os.setstate(std::ios_base::badbit);
+
+    report(stats, counts, input_buffer.bytes(), output_buffer.bytes(),
+           input_buffer.seconds() + output_buffer.seconds(), start, true);
+}
+
+
+/**
+     * Runs `f(os)`, which returns `CodeCounts`, on input of `bytes_in` bytes
+     * in memory, and fills in `stats`, if any, like `run_on_streams()`.
+*/
+template <typename F>
+void run_on_output(std::uint64_t bytes_in, std::ostream &os, Stats *stats, F f)
+{
+    if (stats == nullptr)
+    {
+        f(os);
+        return;
+    }
+
+    const Clock::time_point start {Clock::now()};
+
+    TimedStreambuf output_buffer(*os.rdbuf());
+    std::ostream output(&output_buffer);
+
+    output.exceptions(os.exceptions());
+
+    const CodeCounts counts {f(output)};
+
+    if (output.bad())
+        os.setstate(std::ios_base::badbit);
+
+    report(stats, counts, bytes_in, output_buffer.bytes(), output_buffer.seconds(), start);
+}
+
+
+/// Stream buffer dropping whatever is written to it, for `verify()`.
+class DiscardStreambuf: public std::streambuf
+{
+protected:
+
+    std::streamsize xsputn(const char *, std::streamsize n) override
+    {
+        return n;
+    }
+
+    int_type overflow(int_type c) override
+    {
+        return traits_type::not_eof(c);
+    }
+};
+
+
+/// Returns the rest of `is`.
+std::vector<char> read_all(std::istream &is)
+{
+    std::vector<char> data;
+    std::size_t used {0};
+
+    do
+    {
+        data.resize(used + 1024 * 1024);
+        is.read(data.data() + used, data.size() - used);
+        used += static_cast<std::size_t> (is.gcount());
+    }
+    while (used == data.size());
+
+    data.resize(used);
+    return data;
+}
+
+
+/**
+     * Checks `options` and writes the common header of a file compressed with
+     * them, and the ID of the seed dictionary, if any.
+     *
+     * @param [out] os     `std::ostream` or `VectorOutput`
+     * @param options      how the file is compressed
+     * @param filtered     whether the data compressed is the output of `bmp_filter()`
+*/
+template <typename Sink>
+void write_header(Sink &os, const Options &options, bool filtered)
+{
+    if (!supported_code_width(options.bits))
+        throw std::invalid_argument("unsupported code width");
+
+    if (options.seed != nullptr && options.block_size != 0)
+        throw std::invalid_argument("a seed dictionary cannot be combined with blocks");
+
+    const char header[format::header_size] {
+        format::magic[0], format::magic[1], format::magic[2], format::magic[3],
+        static_cast<char> (options.seed != nullptr ? format::version_seeded_stream
+                           : options.block_size == 0 ? format::version_stream
+                           : options.checksums ? format::version_checked_blocks : format::version_blocks),
+        static_cast<char> (header_width(options) | (filtered ? format::flag_bmp_filter : 0))
+    };
+
+    os.write(header, sizeof header);
+
+    if (options.seed != nullptr)
+    {
+        char id[format::seed_id_size];
+
+        format::put_u32(id, options.seed->id());
+        os.write(id, sizeof id);
+    }
+}
+
+
+/**
+     * Transforms the input with `bmp_filter()` if `options` asks for it and
+     * the input is a BMP image that compresses better for it.
+     *
+     * @param [in,out] data    input, replaced with `filtered.data()` if it is transformed
+     * @param size             number of bytes at `data`
+     * @param options          how the input is compressed
+     * @param [out] filtered   transformed input
+     * @return                 whether the input was transformed
+*/
+bool filter_input(const char *&data, std::size_t size, const Options &options, std::vector<char> &filtered)
+{
+    if (!options.bmp_filter || !filterable_bmp(data, size))
+        return false;
+
+    const BmpFilter filter {choose_bmp_filter(data, size, [&](const char *sample, std::size_t sample_size) {
+        std::vector<char> out;
+        MemoryInput input {sample, sample + sample_size};
+        CodeWriter writer(out);
+
+        compress_codes(input, writer, options);
+        writer.finish();
+        return out.size();
+    })};
+
+    if (filter == BmpFilter::None)
+        return false;
+
+    filtered.resize(size);
+    bmp_filter(data, size, filter, filtered.data());
+    data = filtered.data();
+    return true;
+}
+
+
+/// Compresses the `size` bytes at `data`, appending the file to `out`.
+CodeCounts compress_memory(const char *data, std::size_t size, std::vector<char> &out, const Options &options)
+{
+    VectorOutput output {out};
+    std::vector<char> filtered;
+
+    write_header(output, options, filter_input(data, size, options, filtered));
+
+    if (options.block_size != 0)
+        return compress_blocks(data, size, out, options);
+
+    MemoryInput input {data, data + size};
+    CodeWriter writer(out);
+    const CodeCounts counts {compress_codes(input, writer, options)};
+
+    writer.finish();
+    return counts;
+}
+
+
+/// Compresses the `size` bytes at `data`, writing the file to `os`.
+CodeCounts compress_memory(const char *data, std::size_t size, std::ostream &os, const Options &options)
+{
+    std::vector<char> filtered;
+
+    write_header(os, options, filter_input(data, size, options, filtered));
+
+    if (options.block_size != 0)
+        return compress_blocks(data, size, os, options);
+
+    MemoryInput input {data, data + size};
+    CodeWriter writer(os);
+    const CodeCounts counts {compress_codes(input, writer, options)};
+
+    writer.finish();
+    return counts;
+}
+
+
+/// Returns the version of the compressed file at `data`, 0 for a headerless one.
+unsigned int file_version(const char *data, std::size_t size)
+{
+    if (size < format::header_size || !format::has_magic(data))
+        return 0;
+
+    return static_cast<std::uint8_t> (data[4]);
+}
+
+
+/// Returns whether the compressed file at `data` holds the output of `bmp_filter()`.
+bool file_filtered(const char *data, std::size_t size)
+{
+    return file_version(data, size) != 0 && format::has_bmp_filter(data);
+}
+
+
+/**
+     * Returns how the codes of a version 4 file were written.
+     *
+     * @param header   the header of the file, followed by the ID of its seed dictionary
+     * @throw std::runtime_error if the seed dictionary has not been added
+*/
+CodeFormat seeded_code_format(const char *header)
+{
+    CodeFormat code_format {header_code_format(header)};
+
+    if (supported_code_width(code_format.bits))
+        code_format.seed = find_seed_dictionary(format::get_u32(header + format::header_size)).seed(code_format.bits);
+
+    return code_format;
+}
+
+
+/// Decodes the version 0, 1 or 4 file at `data` into `output`.
+template <typename Output>
+CodeCounts decompress_single(const char *data, std::size_t size, Output &output)
+{
+    switch (file_version(data, size))
+    {
+        case 0:
+        {
+            CodeReader reader(data, data + size);
+
+            return decompress_codes(reader, output, legacy_code_format);
+        }
+
+        case format::version_stream:
+        {
+            CodeReader reader(data + format::header_size, data + size);
+
+            return decompress_codes(reader, output, header_code_format(data));
+        }
+
+        case format::version_seeded_stream:
+        {
+            if (size < format::header_size + format::seed_id_size)
+                throw std::runtime_error("corrupted compressed file");
+
+            CodeReader reader(data + format::header_size + format::seed_id_size, data + size);
+
+            return decompress_codes(reader, output, seeded_code_format(data));
+        }
+
+        default:
+            throw std::runtime_error("unsupported file format version");
+    }
+}
+
+
+/// Decodes the file at `data` to `os`, without undoing `bmp_filter()`.
+CodeCounts decode_memory(const char *data, std::size_t size, std::ostream &os, unsigned int threads)
+{
+    if (format::has_blocks(file_version(data, size)))
+        return decompress_blocks(data, size, os, header_code_format(data), threads);
+
+    StreamOutput sink(os);
+    const CodeCounts counts {decompress_single(data, size, sink)};
+
+    sink.flush();
+    return counts;
+}
+
+
+/// Decompresses the file at `data`, appending the original data to `out`.
+CodeCounts decompress_memory(const char *data, std::size_t size, std::vector<char> &out, unsigned int threads)
+{
+    const std::size_t used {out.size()};
+    std::uint64_t original_size;
+    CodeCounts counts;
+
+    if (!recorded_size(data, size, original_size))
+    {
+        VectorOutput output {out};
+
+        counts = decompress_single(data, size, output);
+    }
+    else
+    {
+        if (original_size > out.max_size() - out.size())
+            throw std::runtime_error("original data too large for memory");
+
+        out.resize(used + static_cast<std::size_t> (original_size));
+        counts = decompress_blocks(data, size, out.data() + used, out.size() - used,
+                                   header_code_format(data), threads);
+    }
+
+    if (file_filtered(data, size))
+        bmp_unfilter(out.data() + used, out.size() - used);
+
+    return counts;
+}
+
+
+/**
+     * Decompresses the range of `decompress_range()` and returns the work done.
+     *
+     * @param unfilter         whether to undo `bmp_filter()`, which `verify()` has no need for
+     * @param [out] version    version of the file
+*/
+CodeCounts decompress_stream(std::istream &is, std::ostream &os, std::uint64_t offset, std::uint64_t length,
+                             unsigned int threads, bool unfilter, unsigned int &version)
+{
+    const bool whole {offset == 0 && length == std::numeric_limits<std::uint64_t>::max()};
+
+    length = std::min(length, std::numeric_limits<std::uint64_t>::max() - offset);
+
+    char header[format::header_size];
+
+    is.read(header, sizeof header);
+
+    const std::size_t header_length {static_cast<std::size_t> (is.gcount())};
+    StreamOutput output(os);
+    WindowOutput window {os, offset, length};
+    CodeCounts counts;
+
+    version = 0;
+
+    if (header_length < sizeof header || !format::has_magic(header))
+    {
+        // a version 0 file has no header, what was read is already its first codes
+        CodeReader reader(is, header, header_length);
+
+        if (!whole)
+            return decompress_codes(reader, window, legacy_code_format);
+
+        counts = decompress_codes(reader, output, legacy_code_format);
+        output.flush();
+        return counts;
+    }
+
+    const CodeFormat code_format {header_code_format(header)};
+
+    version = static_cast<std::uint8_t> (header[4]);
+
+    if (unfilter && format::has_bmp_filter(header))
+    {
+        // the filter is undone on the whole data at once
+        std::vector<char> file(header, header + sizeof header);
+        const std::vector<char> rest {read_all(is)};
+        std::vector<char> data;
+
+        file.insert(file.end(), rest.begin(), rest.end());
+        counts = decompress_memory(file.data(), file.size(), data, threads);
+
+        if (offset < data.size())
+            os.write(data.data() + offset, static_cast<std::streamsize> (std::min<std::uint64_t> (length, data.size() - offset)));
+
+        return counts;
+    }
+
+    switch (version)
+    {
+        case format::version_stream:
+        case format::version_seeded_stream:
+        {
+            char seeded_header[format::header_size + format::seed_id_size];
+            CodeFormat stream_format {code_format};
+
+            if (version == format::version_seeded_stream)
+            {
+                std::copy(header, header + sizeof header, seeded_header);
+
+                if (!is.read(seeded_header + sizeof header, format::seed_id_size))
+                    throw std::runtime_error("corrupted compressed file");
+
+                stream_format = seeded_code_format(seeded_header);
+            }
+
+            CodeReader reader(is);
+
+            if (!whole)
+                return decompress_codes(reader, window, stream_format);
+
+            counts = decompress_codes(reader, output, stream_format);
+            output.flush();
+            return counts;
+        }
+
+        case format::version_blocks:
+        case format::version_checked_blocks:
+            if (whole)
+                return decompress_blocks(is, os, code_format, version, threads);
+
+            return decompress_block_range(is, os, code_format, version, offset, length, threads);
+
+        default:
+            throw std::runtime_error("unsupported file format version");
+    }
+}
+
+} // namespace
+
+
+bool supported_code_width(unsigned int bits)
+{
+    return bits == 12 || bits == 16 || bits == 20 || bits == 24;
+}
+
+
+Options level_options(unsigned int level)
+{
+    struct Level
+    {
+        unsigned int bits;
+        FullDictionary full_dictionary;
+        bool bmp_filter;
+        std::size_t block_size;
+    };
+
+    static const Level levels[best_level - fastest_level + 1] {
+        {12, FullDictionary::Reset, false, 1024 * 1024},
+        {16, FullDictionary::Reset, false, 1024 * 1024},
+        {16, FullDictionary::Clear, true, 4 * 1024 * 1024},
+        {20, FullDictionary::Clear, true, 16 * 1024 * 1024}
+    };
+
+    if (level < fastest_level || level > best_level)
+        throw std::invalid_argument("unsupported compression level");
+
+    const Level &l = levels[level - fastest_level];
+    Options options;
+
+    options.bits = l.bits;
+    options.full_dictionary = l.full_dictionary;
+    options.bmp_filter = l.bmp_filter;
+    options.block_size = l.block_size;
+
+    return options;
+}
+
+
+void release_codec_contexts()
+{
+    ContextPools::clear_all();
+}
+
+
+void compress(const char *data, std::size_t size, std::vector<char> &out, const Options &options)
+{
+    const Clock::time_point start {Clock::now()};
+    const std::size_t used {out.size()};
+    const CodeCounts counts {compress_memory(data, size, out, options)};
+
+    report(options.stats, counts, size, out.size() - used, 0, start);
+}
+
+
+void compress(const char *data, std::size_t size, std::ostream &os, const Options &options)
+{
+    run_on_output(size, os, options.stats, [&](std::ostream &output) {
+        return compress_memory(data, size, output, options);
+    });
+}
+
+
+/**
+     * The output is a version 1 file, a single stream of variable-width codes,
+     * version 4 with a seed dictionary, or a version 3 file, version 2 without
+     * checksums, if `options` asks for blocks.
+*/
+void compress(std::istream &is, std::ostream &os, const Options &options)
+{
+    run_on_streams(is, os, options.stats, [&](std::istream &input, std::ostream &output) -> CodeCounts {
+        if (options.bmp_filter)
+        {
+            const std::vector<char> data {read_all(input)};
+
+            return compress_memory(data.data(), data.size(), output, options);
+        }
+
+        write_header(output, options, false);
+
+        if (options.block_size != 0)
+            return compress_blocks(input, output, options);
+
+        StreamInput source(input);
+        CodeWriter writer(output);
+        const CodeCounts counts {compress_codes(source, writer, options)};
+
+        writer.finish();
+        return counts;
+    });
+}
+
+
+bool recorded_size(const char *data, std::size_t size, std::uint64_t &original_size)
+{
+    if (!format::has_blocks(file_version(data, size)))
+        return false;
+
+    original_size = blocks_original_size(data, size);
+    return true;
+}
+
+
+void decompress(const char *data, std::size_t size, std::vector<char> &out, unsigned int threads, Stats *stats)
+{
+    const Clock::time_point start {Clock::now()};
+    const std::size_t used {out.size()};
+    const CodeCounts counts {decompress_memory(data, size, out, threads)};
+
+    report(stats, counts, size, out.size() - used, 0, start);
+}
+
+
+void decompress(const char *data, std::size_t size, char *out, std::size_t out_size, unsigned int threads,
+                Stats *stats)
+{
+    const Clock::time_point start {Clock::now()};
+    CodeCounts counts;
+
+    if (format::has_blocks(file_version(data, size)))
+        counts = decompress_blocks(data, size, out, out_size, header_code_format(data), threads);
+    else
+    {
+        SpanOutput output {out, out + out_size};
+
+        counts = decompress_single(data, size, output);
+
+        if (output.first != output.last)
+            throw std::runtime_error("output size does not match the original size");
+    }
+
+    if (file_filtered(data, size))
+        bmp_unfilter(out, out_size);
+
+    report(stats, counts, size, out_size, 0, start);
+}
+
+
+void decompress(const char *data, std::size_t size, std::ostream &os, unsigned int threads, Stats *stats)
+{
+    run_on_output(size, os, stats, [&](std::ostream &output) -> CodeCounts {
+        if (file_filtered(data, size))
+        {
+            std::vector<char> out;
+            const CodeCounts counts {decompress_memory(data, size, out, threads)};
+
+            output.write(out.data(), static_cast<std::streamsize> (out.size()));
+            return counts;
+        }
+
+        return decode_memory(data, size, output, threads);
+    });
+}
+
+
+/**
+     * Reads version 1 to 4 files, and headerless version 0 files of fixed 16-bit codes.
+*/
+void decompress(std::istream &is, std::ostream &os, unsigned int threads, Stats *stats)
+{
+    decompress_range(is, os, 0, std::numeric_limits<std::uint64_t>::max(), threads, stats);
+}
+
+
+void decompress_range(std::istream &is, std::ostream &os, std::uint64_t offset, std::uint64_t length,
+                      unsigned int threads, Stats *stats)
+{
+    run_on_streams(is, os, stats, [&](std::istream &input, std::ostream &output) {
+        unsigned int version;
+
+        return decompress_stream(input, output, offset, length, threads, true, version);
+    });
+}
+
+
+bool verify(std::istream &is, unsigned int threads, Stats *stats)
+{
+    DiscardStreambuf discard;
+    std::ostream os(&discard);
+    unsigned int version {0};
+
+    run_on_streams(is, os, stats, [&](std::istream &input, std::ostream &output) {
+        return decompress_stream(input, output, 0, std::numeric_limits<std::uint64_t>::max(), threads, false, version);
+    });
+
+    return version == format::version_checked_blocks;
+}
+
+
+bool verify(const char *data, std::size_t size, unsigned int threads, Stats *stats)
+{
+    DiscardStreambuf discard;
+    std::ostream os(&discard);
+
+    run_on_output(size, os, stats, [&](std::ostream &output) {
+        return decode_memory(data, size, output, threads);
+    });
+
+    return file_version(data, size) == format::version_checked_blocks;
+}
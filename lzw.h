@@ -0,0 +1,392 @@
+#ifndef MEGALZW_LZW_H
+#define MEGALZW_LZW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+
+class ProgressObserver;
+class SeedDictionary;
+
+
+/// Compressor dictionary engines, see dictionary.h.
+enum class DictionaryEngine {
+    Flat,
+    Map
+};
+
+/// What the codec does once the dictionary is full.
+enum class FullDictionary {
+    Reset,      ///< start over from the 256 single-byte strings
+    Clear,      ///< keep it, and clear it with a clear code once the ratio gets worse
+    Recycle     ///< keep it, replacing its oldest leaves with the new strings
+};
+
+/// Maximum code width used when none is asked for.
+const unsigned int default_code_width {16};
+
+/// Block size used when blocks are asked for without a size.
+const std::size_t default_block_size {4 * 1024 * 1024};
+
+/// Largest block size, in bytes.
+const std::size_t max_block_size {1024 * 1024 * 1024};
+
+/// Fastest compression level of `level_options()`.
+const unsigned int fastest_level {1};
+
+/// Compression level of `level_options()` with the best ratio.
+const unsigned int best_level {4};
+
+
+/**
+     * What a call of `compress()` or `decompress()` did, to find the inputs
+     * that compress poorly or keep filling the dictionary up.
+     *
+     * Times are wall-clock. I/O time is the time spent reading and writing
+     * streams, and codec time the rest; calls on memory buffers do no I/O.
+*/
+struct Stats
+{
+    /// Bytes read from the input.
+    std::uint64_t bytes_in {0};
+
+    /// Bytes written to the output.
+    std::uint64_t bytes_out {0};
+
+    /// Codes written or read.
+    std::uint64_t codes {0};
+
+    /// Times the dictionary filled up and started over, in any block.
+    std::uint64_t resets {0};
+
+    double io_seconds {0};
+    double codec_seconds {0};
+
+    /// Peak resident memory of the process by the end of the call, in bytes, 0 if unknown; see `peak_memory()`.
+    std::uint64_t peak_memory {0};
+
+    /// Observer notified of the progress of the call as it goes, or null; see progress.h.
+    ProgressObserver *progress {nullptr};
+};
+
+
+/// Settings of `compress()`.
+struct Options
+{
+    /// Maximum code width, see `supported_code_width()`.
+    unsigned int bits {default_code_width};
+
+    /// Compressor dictionary engine; `FullDictionary::Recycle` has an engine of its own.
+    DictionaryEngine engine {DictionaryEngine::Flat};
+
+    /**
+     * What to do once the dictionary is full.
+     *
+     * Clearing it only when the ratio gets worse helps when the data changes
+     * character, such as the pixels after a BMP header or concatenated
+     * files. Recycling its leaves, the strings no other one extends, helps
+     * with long homogeneous data, such as large scans, which otherwise lose
+     * their ratio every time the dictionary starts over.
+    */
+    FullDictionary full_dictionary {FullDictionary::Reset};
+
+    /**
+     * Whether to transform the pixels of a BMP image with `bmp_filter()`
+     * before compressing them. Input that is not such an image is compressed
+     * as it is. The whole input is filtered at once, so streams are read
+     * into memory first, and decompressing the file does the same.
+    */
+    bool bmp_filter {false};
+
+    /// Input bytes per independently compressed block, or 0 for a single code stream.
+    std::size_t block_size {0};
+
+    /**
+     * Whether blocks carry CRC-32C checksums, which decompressing them
+     * checks, so that a corrupted file is an error rather than wrong data.
+     * Files of blocks are version 3 with them and version 2 without; a
+     * single code stream has no room for them.
+    */
+    bool checksums {true};
+
+    /**
+     * Strings the dictionary starts from, or null for the single bytes alone;
+     * see seed_dictionary.h. The file is version 4 and records the ID of the
+     * seed, and decompressing it needs the same seed, added with
+     * `add_seed_dictionary()`. Cannot be combined with blocks, which are
+     * large enough not to need one.
+    */
+    const SeedDictionary *seed {nullptr};
+
+    /// Number of threads compressing blocks, 0 for one per hardware thread.
+    unsigned int threads {0};
+
+    /// Where to report what `compress()` did, or null.
+    Stats *stats {nullptr};
+};
+
+
+/**
+     * Returns whether the codec is built for codes at most `bits` wide.
+     *
+     * The codec is a template on the maximum code width; only 12, 16, 20 and
+     * 24 bits are instantiated.
+     *
+     * @param bits     maximum code width
+     * @return         true if `compress()` accepts `bits`
+*/
+bool supported_code_width(unsigned int bits);
+
+/**
+     * Returns the settings of compression level `level`, from
+     * `fastest_level` to `best_level`.
+     *
+     * The fastest level uses 12-bit codes, whose dictionary stays in the
+     * cache, and 1 MiB blocks compressed in parallel. The levels after it
+     * widen the codes to 16 and then 20 bits, add adaptive resets and the
+     * BMP filter, and make the blocks larger, down to 0.2 of the size of
+     * a BMP image at the best level against 0.8 at the fastest. Every
+     * level writes blocks; the fields a level does not mention keep their
+     * defaults.
+     *
+     * @param level    compression level
+     * @throw std::invalid_argument if `level` is not one
+*/
+Options level_options(unsigned int level);
+
+/**
+     * Compresses the `size` bytes at `data` and appends the result to `out`.
+     *
+     * This is the codec's own entry point; the stream overloads only adapt
+     * their streams to it.
+     *
+     * @param data         original data
+     * @param size         number of bytes at `data`
+     * @param [out] out    buffer the compressed file is appended to
+     * @param options      how to compress
+*/
+void compress(const char *data, std::size_t size, std::vector<char> &out, const Options &options = Options());
+
+/**
+     * Compresses the contents of `is` and writes the result to `os`.
+     *
+     * @param [in] is      input stream
+     * @param [out] os     output stream
+     * @param options      how to compress
+*/
+void compress(std::istream &is, std::ostream &os, const Options &options = Options());
+
+/**
+     * Compresses the `size` bytes at `data` and writes the result to `os`.
+     *
+     * @param data         original data
+     * @param size         number of bytes at `data`
+     * @param [out] os     output stream
+     * @param options      how to compress
+*/
+void compress(const char *data, std::size_t size, std::ostream &os, const Options &options = Options());
+
+/**
+     * Decompresses the contents of `is` and writes the result to `os`.
+     *
+     * @param [in] is      input stream
+     * @param [out] os     output stream
+     * @param threads      threads decoding the blocks of version 2 and 3 files, 0 for one per hardware thread
+     * @param [out] stats  where to report what was done, or null
+*/
+void decompress(std::istream &is, std::ostream &os, unsigned int threads = 0, Stats *stats = nullptr);
+
+/**
+     * Decodes the contents of `is` and drops the original data, to check that
+     * the file is intact without writing it anywhere.
+     *
+     * Only version 3 files have checksums; in others only codes that do not
+     * decode, or blocks that do not match their sizes, are found. The
+     * `bytes_out` of `stats` is the size of the original data.
+     *
+     * @param [in] is      input stream
+     * @param threads      threads decoding the blocks of version 2 and 3 files, 0 for one per hardware thread
+     * @param [out] stats  where to report what was done, or null
+     * @return             whether the file had checksums to check
+     * @throw std::runtime_error if the file is corrupted or a checksum does not match
+*/
+bool verify(std::istream &is, unsigned int threads = 0, Stats *stats = nullptr);
+
+/**
+     * Like the overload above, for a compressed file in memory.
+     *
+     * @param data         the whole compressed file
+     * @param size         size of the file
+     * @param threads      threads decoding the blocks of version 2 and 3 files, 0 for one per hardware thread
+     * @param [out] stats  where to report what was done, or null
+     * @return             whether the file had checksums to check
+*/
+bool verify(const char *data, std::size_t size, unsigned int threads = 0, Stats *stats = nullptr);
+
+/**
+     * Decompresses `length` bytes of the original data, starting `offset` bytes in.
+     *
+     * In version 2 and 3 files only the blocks covering the range are decoded;
+     * other versions have to be decoded from the start.
+     *
+     * @param [in] is      seekable input stream
+     * @param [out] os     output stream
+     * @param offset       position of the first byte wanted in the original data
+     * @param length       number of bytes wanted; fewer are written if the data ends first
+     * @param threads      threads decoding the blocks of version 2 and 3 files, 0 for one per hardware thread
+     * @param [out] stats  where to report what was done, or null
+*/
+void decompress_range(std::istream &is, std::ostream &os, std::uint64_t offset, std::uint64_t length,
+                      unsigned int threads = 0, Stats *stats = nullptr);
+
+/**
+     * Looks up the size of the original data of a compressed file in memory.
+     *
+     * Only version 2 and 3 files record it.
+     *
+     * @param data                 the whole compressed file
+     * @param size                 size of the file
+     * @param [out] original_size  size of the original data, if recorded
+     * @return                     true if the file records the size
+*/
+bool recorded_size(const char *data, std::size_t size, std::uint64_t &original_size);
+
+/**
+     * Decompresses the compressed file at `data` and appends the result to `out`.
+     *
+     * The original size of a version 2 or 3 file is known up front, so `out` grows
+     * once and the blocks are decoded in parallel straight into it.
+     *
+     * @param data         the whole compressed file
+     * @param size         size of the file
+     * @param [out] out    buffer the original data is appended to
+     * @param threads      threads decoding the blocks of version 2 and 3 files, 0 for one per hardware thread
+     * @param [out] stats  where to report what was done, or null
+*/
+void decompress(const char *data, std::size_t size, std::vector<char> &out, unsigned int threads = 0,
+                Stats *stats = nullptr);
+
+/**
+     * Decompresses the compressed file at `data` and writes the result to `os`.
+     *
+     * @param data         the whole compressed file
+     * @param size         size of the file
+     * @param [out] os     output stream
+     * @param threads      threads decoding the blocks of version 2 and 3 files, 0 for one per hardware thread
+     * @param [out] stats  where to report what was done, or null
+*/
+void decompress(const char *data, std::size_t size, std::ostream &os, unsigned int threads = 0,
+                Stats *stats = nullptr);
+
+/**
+     * Decompresses the compressed file at `data` into the `out_size` bytes at `out`.
+     *
+     * The blocks of a version 2 or 3 file are decoded in parallel, each straight
+     * into its place in `out`.
+     *
+     * @param data         the whole compressed file
+     * @param size         size of the file
+     * @param [out] out    destination of the original data
+     * @param out_size     size of `out`, which must be that of the original data
+     * @param threads      threads decoding the blocks of version 2 and 3 files, 0 for one per hardware thread
+     * @param [out] stats  where to report what was done, or null
+*/
+void decompress(const char *data, std::size_t size, char *out, std::size_t out_size, unsigned int threads = 0,
+                Stats *stats = nullptr);
+
+
+/**
+     * Frees the codec states that calls of `compress()` and `decompress()`
+     * keep for those after them.
+     *
+     * Each call takes the state, dictionary storage included, that an
+     * earlier call left, so that repeated calls on single code streams in
+     * memory do not allocate once as many states as threads calling them
+     * exist. A state of 24-bit codes is hundreds of megabytes, which this
+     * gives back to the system; only states no call is using are freed.
+*/
+void release_codec_contexts();
+
+
+/**
+     * Incremental compressor, for input that arrives a piece at a time.
+     *
+     * The dictionary and the string still being matched are kept between
+     * calls, so the output is the same version 1 file `compress()` writes for
+     * the whole input, whatever the pieces. Each call appends whatever output
+     * is complete to `out`.
+*/
+class LzwEncoder
+{
+public:
+
+    /// State for one code width and engine, defined in streaming.cpp.
+    class Impl;
+
+    /// @param options     code width, dictionary engine and reset policy; blocks are not supported
+    explicit LzwEncoder(const Options &options = Options());
+    ~LzwEncoder();
+
+    LzwEncoder(const LzwEncoder &) = delete;
+    LzwEncoder &operator=(const LzwEncoder &) = delete;
+
+    /**
+     * Compresses the next `size` bytes of the input.
+     *
+     * @param data         next piece of the original data
+     * @param size         number of bytes at `data`
+     * @param [out] out    buffer the compressed bytes ready so far are appended to
+    */
+    void feed(const char *data, std::size_t size, std::vector<char> &out);
+
+    /// Ends the input and appends the rest of the compressed file to `out`.
+    void finish(std::vector<char> &out);
+
+private:
+
+    std::unique_ptr<Impl> impl_;
+};
+
+
+/**
+     * Incremental decompressor, for compressed input that arrives a piece at a time.
+     *
+     * Reads version 1 and 4 files and headerless version 0 files. The dictionary and
+     * the bits of a code split between pieces are kept between calls.
+*/
+class LzwDecoder
+{
+public:
+
+    /// State for the code width in the header, defined in streaming.cpp.
+    class Impl;
+
+    LzwDecoder();
+    ~LzwDecoder();
+
+    LzwDecoder(const LzwDecoder &) = delete;
+    LzwDecoder &operator=(const LzwDecoder &) = delete;
+
+    /**
+     * Decompresses the next `size` bytes of the compressed file.
+     *
+     * @param data         next piece of the compressed file
+     * @param size         number of bytes at `data`
+     * @param [out] out    buffer the original data decoded so far is appended to
+    */
+    void feed(const char *data, std::size_t size, std::vector<char> &out);
+
+    /// Ends the input, checking that the compressed file was not cut short.
+    void finish(std::vector<char> &out);
+
+private:
+
+    std::unique_ptr<Impl> impl_;
+    std::vector<char> header_;  ///< first bytes of the file, until there are enough to tell its version
+};
+
+#endif // MEGALZW_LZW_H
@@ -1,177 +1,389 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "archive.h"
+#include "async_file_streambuf.h"
+#include "lzw.h"
+#include "mapped_file.h"
+#include "memory_budget.h"
+#include "pipelined_streambuf.h"
+#include "progress.h"
+#include "seed_dictionary.h"
 
-/// Type used to store and retrieve codes.
-using CodeType = std::uint16_t;
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
-namespace globals {
 
-/// Dictionary Maximum Size (when reached, the dictionary will be reset)
-    const CodeType dms {std::numeric_limits<CodeType>::max()};
+/**
+     * Prints usage information and a custom error message.
+     *
+     * @param s    custom error message to be printed
+     * @param su   Show Usage information
+     * @return void
+*/
+void print_usage(const std::string &s = "", bool su = true)
+{
+    if (!s.empty())
+        std::cerr << "\nERROR: " << s << '\n';
+
+    if (su)
+    {
+        std::cerr << "\nUsage:\n";
+        std::cerr << "\tprogram --flag [options] input_file output_file.lzw\n\n";
+        std::cerr << "\tprogram --verify [options] input_file.lzw\n";
+        std::cerr << "\tprogram --archive [options] archive.lzwa input_file...\n";
+        std::cerr << "\tprogram --list archive.lzwa\n";
+        std::cerr << "\tprogram --extract [options] archive.lzwa member output_file\n";
+        std::cerr << "\tprogram --train [options] seed_file sample_file...\n\n";
+        std::cerr << "Where `flag' is either `compress' for compressing, or `decompress' for decompressing, and\n";
+        std::cerr << "`input_file' and `output_file' are distinct files, or `-' for the standard input or output.\n";
+        std::cerr << "`verify' decodes a compressed file and checks its checksums without writing the original data\n";
+        std::cerr << "anywhere. `archive' compresses many files at once, one per thread, into an archive, and\n";
+        std::cerr << "`extract' decompresses one of them, `member' being its name as listed by `list'. `train' builds\n";
+        std::cerr << "a seed dictionary from sample files, for `--seed' to compress small files like them better.\n\n";
+        std::cerr << "Options:\n";
+        std::cerr << "\t--level=1..4            settings from the fastest (1) to the best ratio (4), which options override\n";
+        std::cerr << "\t--dictionary=flat|map   compressor dictionary engine (default: flat)\n";
+        std::cerr << "\t--bits=12|16|20|24      maximum code width (default: 16)\n";
+        std::cerr << "\t--adaptive-reset        clear a full dictionary once the ratio gets worse, not when it fills up\n";
+        std::cerr << "\t--lru                   replace the least recently used leaves of a full dictionary instead\n";
+        std::cerr << "\t--bmp-filter            delta-code and split the color channels of BMP images first\n";
+        std::cerr << "\t--block-size=SIZE       compress blocks of SIZE bytes (K, M and G suffixes) independently\n";
+        std::cerr << "\t--no-checksums          leave the CRC-32C checksums out of the blocks\n";
+        std::cerr << "\t--threads=N             threads compressing or decompressing blocks (default: one per core)\n";
+        std::cerr << "\t--max-memory=SIZE       lower the code width, block size and threads to compress in SIZE bytes\n";
+        std::cerr << "\t--seed=FILE             start the dictionary from the seed dictionary FILE, without blocks\n";
+        std::cerr << "\t--seed-size=N           strings of the seed dictionary `train' builds (default: 32512)\n";
+        std::cerr << "\t--range=OFFSET:LENGTH   decompress only LENGTH bytes starting OFFSET bytes in\n";
+        std::cerr << "\t--mmap                  map the files into memory instead of reading and writing them\n";
+        std::cerr << "\t--pipeline              read ahead and write behind on threads of their own\n";
+        std::cerr << "\t--async-io              keep several large reads and writes in flight (io_uring on Linux)\n";
+        std::cerr << "\t--progress              show the bytes done, the throughput and the time left as it goes\n";
+        std::cerr << "\t--stats[=text|json]     report bytes, codes, dictionary resets, times and peak memory\n\n";
+        std::cerr << "Examples:\n";
+        std::cerr << "\tmegalzw.exe --compress input.bmp output_file.lzv\n";
+        std::cerr << "\tmegalzw.exe --dcompress input_file.lzw output_file.bmp\n";
+        std::cerr << "\ttar c dir | megalzw.exe --compress - - | ssh host 'cat > dir.tar.lzw'\n";
+        std::cerr << "\tmegalzw.exe --archive --bmp-filter images.lzwa images/*.bmp\n";
+        std::cerr << "\tmegalzw.exe --train icons.seed icons/*.bmp\n";
+        std::cerr << "\tmegalzw.exe --archive --seed=icons.seed icons.lzwa new_icons/*.bmp\n";
+        std::cerr << "\tmegalzw.exe --compress --level=1 upload.bin upload.lzw\n";
+        std::cerr << "\tmegalzw.exe --archive --level=4 cold.lzwa logs/*\n";
+        std::cerr << "\tmegalzw.exe --compress --bits=24 --threads=16 --max-memory=512M scan.tif scan.lzw\n";
+    }
 
-} // namespace globals
+    std::cerr << std::endl;
+}
+
+/**
+     * Parses a byte count such as `4096`, `64K` or `4M`.
+     *
+     * @param s    number, optionally followed by K, M or G
+     * @return     the byte count, or 0 if `s` is not one
+*/
+std::size_t parse_size(const std::string &s)
+{
+    char *end;
+    errno = 0;
+    const unsigned long long n {std::strtoull(s.c_str(), &end, 10)};
+    std::size_t factor {1};
 
+    switch (*end)
+    {
+        case 'G': factor *= 1024;  // fall through
+        case 'M': factor *= 1024;  // fall through
+        case 'K': factor *= 1024; ++end; break;
+        default: break;
+    }
+
+    // counts past SIZE_MAX, with or without the suffix, and negative ones, which `strtoull()' wraps around, are not sizes
+    if (*end != '\0' || errno == ERANGE || s.find('-') != std::string::npos || n > SIZE_MAX / factor)
+        return 0;
+
+    return static_cast<std::size_t> (n) * factor;
+}
 
 /**
-     * Compresses the contents of `is` and writes the result to `os`.
+     * Switches the standard input and output over to binary data, once `-`
+     * is one of the files.
      *
-     * @param [in] is      input stream
-     * @param su   Show Usage information
-     * @param [out] os     output stream
+     * They are no longer synchronized with C stdio, so the codec's chunks
+     * go straight to and from the file descriptors, as with files.
 */
-void compress(std::istream &is, std::ostream &os)
+void use_standard_streams()
 {
-    std::map<std::pair<CodeType, char>, CodeType> dictionary;
+    std::ios_base::sync_with_stdio(false);
 
-    // "named" lambda function, used to reset the dictionary to its initial contents
-    const auto reset_dictionary = [&dictionary] {
-        dictionary.clear();
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
 
-        const long int minc = std::numeric_limits<char>::min();
-        const long int maxc = std::numeric_limits<char>::max();
+/// Returns the size of the file at `path`, or 0 if it is `-` or cannot be opened.
+std::uint64_t file_size(const std::string &path)
+{
+    if (path == "-")
+        return 0;
 
-        for (long int c = minc; c <= maxc; ++c)
-        {
-            // to prevent Undefined Behavior, resulting from reading and modifying
-            // the dictionary object at the same time
-            const CodeType dictionary_size = dictionary.size();
+    std::ifstream file(path, std::ios_base::binary | std::ios_base::ate);
 
-            dictionary[{globals::dms, static_cast<char> (c)}] = dictionary_size;
-        }
-    };
+    return file.is_open() ? static_cast<std::uint64_t> (file.tellg()) : 0;
+}
+
+/**
+     * Shows the progress of a call on one line of the standard error output,
+     * rewritten at every notification, for `--progress`.
+*/
+class ProgressDisplay: public ProgressObserver
+{
+public:
 
-    reset_dictionary();
+    using ProgressObserver::ProgressObserver;
 
-    CodeType i {globals::dms}; // Index
-    char c;
+protected:
 
-    while (is.get(c))
+    void notify(const Progress &progress) override
     {
-        // dictionary's maximum size was reached
-        if (dictionary.size() == globals::dms)
-            reset_dictionary();
+        const double megabytes {progress.bytes / (1024.0 * 1024.0)};
 
-        if (dictionary.count({i, c}) == 0)
-        {
-            // to prevent Undefined Behavior, resulting from reading and modifying
-            // the dictionary object at the same time
-            const CodeType dictionary_size = dictionary.size();
+        std::cerr << std::fixed << std::setprecision(1) << '\r';
 
-            dictionary[{i, c}] = dictionary_size;
-            os.write(reinterpret_cast<const char *> (&i), sizeof (CodeType));
-            i = dictionary.at({globals::dms, c});
-        }
+        if (progress.total != 0)
+            std::cerr << std::setw(5) << (100.0 * progress.bytes / progress.total) << "% of "
+                      << progress.total / (1024.0 * 1024.0) << " MB, ";
         else
-            i = dictionary.at({i, c});
-    }
+            std::cerr << megabytes << " MB, ";
 
-    if (i != globals::dms)
-        os.write(reinterpret_cast<const char *> (&i), sizeof (CodeType));
-}
+        std::cerr << progress.megabytes_per_second << " MB/s";
 
+        if (progress.done)
+            std::cerr << ", " << progress.seconds << " s      \n";
+        else
+        if (progress.eta_seconds >= 0)
+            std::cerr << ", " << static_cast<unsigned long> (progress.eta_seconds + 0.5) << " s left      ";
+        else
+            std::cerr << "      ";
+
+        std::cerr.flush();
+    }
+};
 
 /**
-     * Decompresses the contents of `is` and writes the result to `os`.
+     * Prints the outcome of compressing, decompressing or verifying a file, and what it took if asked to.
      *
-     * @param [in] is      input stream
-     * @param su   Show Usage information
-     * @param [out] os     output stream
+     * @param operation    `compress`, `decompress`, `verify`, `archive` or `extract`
+     * @param path         the input file, the archive created, or the member extracted
+     * @param stats        what was done
+     * @param report       empty for no report, `text` or `json`
+     * @param [out] out    where to print, the standard error output when the data goes to the standard output
 */
-void decompress(std::istream &is, std::ostream &os)
+void print_result(const std::string &operation, const std::string &path, const Stats &stats, const std::string &report,
+                  std::ostream &out)
 {
-    std::vector<std::pair<CodeType, char>> dictionary;
+    const bool compressed {operation == "compress" || operation == "archive"};
+    const std::uint64_t original {compressed ? stats.bytes_in : stats.bytes_out};
+    const std::uint64_t packed {compressed ? stats.bytes_out : stats.bytes_in};
 
-    // "named" lambda function, used to reset the dictionary to its initial contents
-    const auto reset_dictionary = [&dictionary] {
-        dictionary.clear();
-        dictionary.reserve(globals::dms);
+    // size of the compressed file relative to the original, and original bytes per code
+    const double ratio {original == 0 ? 0.0 : static_cast<double> (packed) / original};
+    const double match {stats.codes == 0 ? 0.0 : static_cast<double> (original) / stats.codes};
 
-        const long int minc = std::numeric_limits<char>::min();
-        const long int maxc = std::numeric_limits<char>::max();
+    out << std::fixed << std::setprecision(1);
 
-        for (long int c = minc; c <= maxc; ++c)
-            dictionary.push_back({globals::dms, static_cast<char> (c)});
-    };
+    if (operation == "compress")
+        out << "The file " << path << " is compressed by " << (original == 0 ? 0.0 : 100 * (1 - ratio)) << "%\n";
+    else
+    if (operation == "archive")
+        out << "The files are compressed by " << (original == 0 ? 0.0 : 100 * (1 - ratio)) << "% into " << path << "\n";
+    else
+    if (operation == "extract")
+        out << "The file " << path << " is extracted."  << "\n";
+    else
+    if (operation == "decompress")
+        out << "The file " << path << " is decompressed."  << "\n";
+    else
+        out << "The file " << path << " is intact."  << "\n";
 
-    const auto rebuild_string = [&dictionary](CodeType k) -> std::vector<char> {
-        std::vector<char> s; // String
+    if (report == "json")
+    {
+        out << std::setprecision(6)
+                  << "{\"operation\": \"" << operation << "\""
+                  << ", \"bytes_in\": " << stats.bytes_in
+                  << ", \"bytes_out\": " << stats.bytes_out
+                  << ", \"ratio\": " << ratio
+                  << ", \"codes\": " << stats.codes
+                  << ", \"dictionary_resets\": " << stats.resets
+                  << ", \"average_match_length\": " << match
+                  << ", \"io_seconds\": " << stats.io_seconds
+                  << ", \"codec_seconds\": " << stats.codec_seconds
+                  << ", \"peak_memory\": " << stats.peak_memory << "}\n";
+    }
+    else
+    if (report == "text")
+    {
+        out << std::setprecision(3)
+                  << "\tbytes in:              " << stats.bytes_in << '\n'
+                  << "\tbytes out:             " << stats.bytes_out << '\n'
+                  << "\tratio:                 " << ratio << '\n'
+                  << "\tcodes:                 " << stats.codes << '\n'
+                  << "\tdictionary resets:     " << stats.resets << '\n'
+                  << "\taverage match length:  " << match << '\n'
+                  << "\tI/O time:              " << stats.io_seconds << " s\n"
+                  << "\tcodec time:            " << stats.codec_seconds << " s\n"
+                  << "\tpeak memory:           " << stats.peak_memory << " bytes\n";
+    }
+}
 
-        while (k != globals::dms)
-        {
-            s.push_back(dictionary.at(k).second);
-            k = dictionary.at(k).first;
-        }
+/**
+     * Creates an archive, lists its members or extracts one of them.
+     *
+     * @param operation    `archive`, `list` or `extract`
+     * @param files        the archive, followed by the files to archive, or by the member and the file to extract it to
+     * @param options      how to compress the files, and the number of threads
+     * @param report       empty for no report, `text` or `json`
+     * @return             `EXIT_SUCCESS` or `EXIT_FAILURE`
+*/
+int run_archive(const std::string &operation, const std::vector<std::string> &files, const Options &options,
+                const std::string &report)
+{
+    const std::string output_path {operation == "archive" ? files[0] : operation == "extract" ? files[2] : ""};
+    const bool standard_output {output_path == "-"};
+    std::ostream &messages = standard_output ? std::cerr : std::cout;
 
-        std::reverse(s.begin(), s.end());
-        return s;
-    };
+    if (standard_output)
+        use_standard_streams();
 
-    reset_dictionary();
+    try
+    {
+        std::ofstream output_file;
 
-    CodeType i {globals::dms}; // Index
-    CodeType k; // Key
+        if (!output_path.empty() && !standard_output)
+        {
+            output_file.open(output_path, std::ios_base::binary);
 
-    while (is.read(reinterpret_cast<char *> (&k), sizeof (CodeType)))
-    {
-        // dictionary's maximum size was reached
-        if (dictionary.size() == globals::dms)
-            reset_dictionary();
+            if (!output_file.is_open())
+            {
+                print_usage(std::string("output_file `") + output_path + "' could not be opened.");
+                return EXIT_FAILURE;
+            }
+        }
 
-        if (k > dictionary.size())
-            throw std::runtime_error("invalid compressed code");
+        std::ostream output(standard_output ? std::cout.rdbuf() : output_file.rdbuf());
 
-        std::vector<char> s; // String
+        output.exceptions(std::ios_base::badbit | std::ios_base::failbit);
 
-        if (k == dictionary.size())
+        if (operation == "archive")
         {
-            dictionary.push_back({i, rebuild_string(i).front()});
-            s = rebuild_string(k);
+            create_archive(std::vector<std::string>(files.begin() + 1, files.end()), output, options);
+            output.flush();
+            print_result(operation, output_path, *options.stats, report, messages);
         }
         else
         {
-            s = rebuild_string(k);
-
-            if (i != globals::dms)
-                dictionary.push_back({i, s.front()});
+            const MappedFile archive(files[0]);
+            const std::vector<ArchiveMember> members {read_archive_table(archive.data(), archive.size())};
+
+            if (operation == "list")
+            {
+                for (const ArchiveMember &member : members)
+                    std::cout << std::setw(14) << member.original_size << std::setw(14) << member.compressed_size
+                              << "  " << member.name << '\n';
+            }
+            else
+            {
+                const auto member = std::find_if(members.begin(), members.end(), [&](const ArchiveMember &m) {
+                    return m.name == files[1];
+                });
+
+                if (member == members.end())
+                {
+                    print_usage(std::string("member `") + files[1] + "' is not in the archive.", false);
+                    return EXIT_FAILURE;
+                }
+
+                extract_member(archive.data(), archive.size(), *member, output, options.threads, options.stats);
+                output.flush();
+                print_result(operation, member->name, *options.stats, report, messages);
+            }
         }
 
-        os.write(&s.front(), s.size());
-        i = k;
+        if (output_file.is_open())
+            output_file.close();
+    }
+    catch (const std::ios_base::failure &f)
+    {
+        print_usage(std::string("File input/output failure: ") + f.what() + '.', false);
+        return EXIT_FAILURE;
+    }
+    catch (const std::exception &e)
+    {
+        print_usage(std::string("Caught exception: ") + e.what() + '.', false);
+        return EXIT_FAILURE;
     }
 
-    if (!is.eof() || is.gcount() != 0)
-        throw std::runtime_error("corrupted compressed file");
+    return EXIT_SUCCESS;
 }
 
 /**
-     * Prints usage information and a custom error message.
+     * Builds a seed dictionary from sample files.
      *
-     * @param s    custom error message to be printed
-     * @param su   Show Usage information
-     * @return void
+     * @param files    the seed dictionary file, followed by the samples
+     * @param size     number of strings of the seed
+     * @return         `EXIT_SUCCESS` or `EXIT_FAILURE`
 */
-void print_usage(const std::string &s = "", bool su = true)
+int run_train(const std::vector<std::string> &files, std::size_t size)
 {
-    if (!s.empty())
-        std::cerr << "\nERROR: " << s << '\n';
+    try
+    {
+        SeedTrainer trainer;
 
-    if (su)
+        for (std::size_t f = 1; f < files.size(); ++f)
+        {
+            const MappedFile sample(files[f]);
+
+            trainer.add(sample.data(), sample.size());
+        }
+
+        const SeedDictionary seed {trainer.train(size)};
+        std::ofstream output_file(files[0], std::ios_base::binary);
+
+        if (!output_file.is_open())
+        {
+            print_usage(std::string("output_file `") + files[0] + "' could not be opened.");
+            return EXIT_FAILURE;
+        }
+
+        output_file.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+        seed.save(output_file);
+        output_file.close();
+
+        std::cout << "The seed dictionary " << files[0] << " holds " << seed.size() << " strings, its ID is "
+                  << std::hex << std::setw(8) << std::setfill('0') << seed.id() << ".\n";
+    }
+    catch (const std::ios_base::failure &f)
     {
-        std::cerr << "\nUsage:\n";
-        std::cerr << "\tprogram --flag input_file output_file.lzw\n\n";
-        std::cerr << "Where `flag' is either `compress' for compressing, or `decompress' for decompressing, and\n";
-        std::cerr << "`input_file' and `output_file' are distinct files.\n\n";
-        std::cerr << "Examples:\n";
-        std::cerr << "\tmegalzw.exe --compress input.bmp output_file.lzv\n";
-        std::cerr << "\tmegalzw.exe --dcompress input_file.lzw output_file.bmp\n";
+        print_usage(std::string("File input/output failure: ") + f.what() + '.', false);
+        return EXIT_FAILURE;
+    }
+    catch (const std::exception &e)
+    {
+        print_usage(std::string("Caught exception: ") + e.what() + '.', false);
+        return EXIT_FAILURE;
     }
 
-    std::cerr << std::endl;
+    return EXIT_SUCCESS;
 }
 
 /**
@@ -184,13 +396,18 @@ void print_usage(const std::string &s = "", bool su = true)
  *
  */
 int main(int argc, char *argv[]) {
-    if (argc < 3) {
+    if (argc < 2) {
         print_usage("Wrong number of arguments.");
         return EXIT_FAILURE;
     }
     enum class Mode {
         Compress,
-        Decompress
+        Decompress,
+        Verify,
+        Archive,
+        List,
+        Extract,
+        Train
     };
 
 
@@ -202,67 +419,575 @@ int main(int argc, char *argv[]) {
     if (std::string(argv[1]) == "--dcompress")
         m = Mode::Decompress;
     else
+    if (std::string(argv[1]) == "--verify")
+        m = Mode::Verify;
+    else
+    if (std::string(argv[1]) == "--archive")
+        m = Mode::Archive;
+    else
+    if (std::string(argv[1]) == "--list")
+        m = Mode::List;
+    else
+    if (std::string(argv[1]) == "--extract")
+        m = Mode::Extract;
+    else
+    if (std::string(argv[1]) == "--train")
+        m = Mode::Train;
+    else
     {
         print_usage(std::string("flag `") + argv[1] + "' is not recognized.");
         return EXIT_FAILURE;
     }
 
+    std::string dictionary_engine {"flat"};
+    Options options;
+    bool range {false};
+    bool mmap {false};
+    bool pipeline {false};
+    bool async_io {false};
+    bool progress {false};
+    bool block_size_given {false};
+    bool threads_given {false};
+    std::string seed_path;
+    std::size_t seed_size {default_seed_size};
+    std::uint64_t max_memory {0};
+    std::string report;
+    Stats stats;
+    std::uint64_t range_offset {0};
+    std::uint64_t range_length {0};
+    std::vector<std::string> files;
+    bool level_given {false};
+
+    // a level is read first, wherever it is, for the other options to override its settings
+    for (int a = 2; a < argc; ++a)
+    {
+        const std::string arg {argv[a]};
 
-    const std::size_t buffer_size {1024 * 1024};
+        if (arg.compare(0, 8, "--level=") == 0)
+        {
+            char *end;
+            const unsigned long level {std::strtoul(arg.c_str() + 8, &end, 10)};
 
-    // these custom buffers should be larger than the default ones
-    const std::unique_ptr<char[]> input_buffer(new char[buffer_size]);
-    const std::unique_ptr<char[]> output_buffer(new char[buffer_size]);
+            if (*end != '\0' || level < fastest_level || level > best_level)
+            {
+                print_usage(std::string("level `") + arg.substr(8) + "' is not supported.");
+                return EXIT_FAILURE;
+            }
 
-    std::ifstream input_file;
-    std::ofstream output_file;
+            options = level_options(static_cast<unsigned int> (level));
+            level_given = true;
+        }
+    }
+
+    for (int a = 2; a < argc; ++a)
+    {
+        const std::string arg {argv[a]};
+
+        if (arg.compare(0, 8, "--level=") == 0)
+            continue;
+        else
+        if (arg.compare(0, 13, "--dictionary=") == 0)
+            dictionary_engine = arg.substr(13);
+        else
+        if (arg.compare(0, 7, "--bits=") == 0)
+        {
+            char *end;
+            const unsigned long bits {std::strtoul(arg.c_str() + 7, &end, 10)};
 
-//    input_file.rdbuf()->pubsetbuf(input_buffer.get(), buffer_size);
-    input_file.open(argv[2], std::ios_base::binary);
+            options.bits = static_cast<unsigned int> (bits);
 
-    if (!input_file.is_open())
+            if (end == arg.c_str() + 7 || *end != '\0' || bits != options.bits || !supported_code_width(options.bits))
+            {
+                print_usage(std::string("code width `") + arg.substr(7) + "' is not supported.");
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        if (arg == "--adaptive-reset")
+            options.full_dictionary = FullDictionary::Clear;
+        else
+        if (arg == "--lru")
+            options.full_dictionary = FullDictionary::Recycle;
+        else
+        if (arg == "--bmp-filter")
+            options.bmp_filter = true;
+        else
+        if (arg.compare(0, 13, "--block-size=") == 0)
+        {
+            options.block_size = parse_size(arg.substr(13));
+
+            if (options.block_size == 0 || options.block_size > max_block_size)
+            {
+                print_usage(std::string("block size `") + arg.substr(13) + "' is not supported.");
+                return EXIT_FAILURE;
+            }
+
+            block_size_given = true;
+        }
+        else
+        if (arg == "--no-checksums")
+            options.checksums = false;
+        else
+        if (arg.compare(0, 10, "--threads=") == 0)
+        {
+            char *end;
+            const unsigned long threads {std::strtoul(arg.c_str() + 10, &end, 10)};
+
+            if (end == arg.c_str() + 10 || *end != '\0' || threads > 0xffff)
+            {
+                print_usage(std::string("thread count `") + arg.substr(10) + "' is not supported.");
+                return EXIT_FAILURE;
+            }
+
+            options.threads = static_cast<unsigned int> (threads);
+            threads_given = true;
+        }
+        else
+        if (arg.compare(0, 13, "--max-memory=") == 0)
+        {
+            max_memory = parse_size(arg.substr(13));
+
+            if (max_memory == 0)
+            {
+                print_usage(std::string("memory budget `") + arg.substr(13) + "' is not supported.");
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        if (arg.compare(0, 7, "--seed=") == 0)
+            seed_path = arg.substr(7);
+        else
+        if (arg.compare(0, 12, "--seed-size=") == 0)
+        {
+            seed_size = parse_size(arg.substr(12));
+
+            if (seed_size == 0 || seed_size > max_seed_size)
+            {
+                print_usage(std::string("seed size `") + arg.substr(12) + "' is not supported.");
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        if (arg.compare(0, 8, "--range=") == 0 && arg.find(':') != std::string::npos)
+        {
+            const std::size_t colon {arg.find(':')};
+
+            const std::string offset {arg.substr(8, colon - 8)};
+            const std::string length {arg.substr(colon + 1)};
+
+            range = true;
+            range_offset = parse_size(offset);
+            range_length = parse_size(length);
+
+            // 0 is also what `parse_size()' returns for what is not a size
+            if ((range_offset == 0 && offset != "0") || (range_length == 0 && length != "0"))
+            {
+                print_usage(std::string("range `") + arg.substr(8) + "' is not supported.");
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        if (arg == "--mmap")
+            mmap = true;
+        else
+        if (arg == "--pipeline")
+            pipeline = true;
+        else
+        if (arg == "--async-io")
+            async_io = true;
+        else
+        if (arg == "--progress")
+            progress = true;
+        else
+        if (arg == "--stats" || arg == "--stats=text" || arg == "--stats=json")
+            report = arg == "--stats=json" ? "json" : "text";
+        else
+        if (arg.compare(0, 2, "--") == 0)
+        {
+            print_usage(std::string("option `") + arg + "' is not recognized.");
+            return EXIT_FAILURE;
+        }
+        else
+            files.push_back(arg);
+    }
+
+    const bool file_count_ok {
+        m == Mode::Archive || m == Mode::Train ? files.size() >= 2 :
+        m == Mode::Verify || m == Mode::List ? files.size() == 1 :
+        m == Mode::Extract ? files.size() == 3 : files.size() == 2
+    };
+
+    if (!file_count_ok)
+    {
+        print_usage("Wrong number of arguments.");
+        return EXIT_FAILURE;
+    }
+
+    if (dictionary_engine != "flat" && dictionary_engine != "map")
+    {
+        print_usage(std::string("dictionary `") + dictionary_engine + "' is not recognized.");
+        return EXIT_FAILURE;
+    }
+
+    if (mmap && range)
+    {
+        print_usage("`--mmap' cannot be combined with `--range'.");
+        return EXIT_FAILURE;
+    }
+
+    if (mmap && pipeline)
+    {
+        print_usage("`--mmap' cannot be combined with `--pipeline'.");
+        return EXIT_FAILURE;
+    }
+
+    if (async_io && (mmap || pipeline))
+    {
+        print_usage(std::string("`--async-io' cannot be combined with `") + (mmap ? "--mmap" : "--pipeline") + "'.");
+        return EXIT_FAILURE;
+    }
+
+    if (range && m != Mode::Decompress)
+    {
+        print_usage("`--range' only applies to `decompress'.");
+        return EXIT_FAILURE;
+    }
+
+    if (seed_path.size() != 0 && block_size_given)
     {
-        print_usage(std::string("input_file `") + argv[2] + "' could not be opened.");
+        print_usage("`--seed' cannot be combined with `--block-size'.");
         return EXIT_FAILURE;
     }
 
-//    output_file.rdbuf()->pubsetbuf(output_buffer.get(), buffer_size);
-    output_file.open(argv[3], std::ios_base::binary);
+    if (max_memory != 0 && m != Mode::Compress && m != Mode::Archive)
+    {
+        print_usage("`--max-memory' only applies to `compress' and `archive'.");
+        return EXIT_FAILURE;
+    }
 
-    if (!output_file.is_open())
+    if (level_given && m != Mode::Compress && m != Mode::Archive)
     {
-        print_usage(std::string("output_file `") + argv[3] + "' could not be opened.");
+        print_usage("`--level' only applies to `compress' and `archive'.");
         return EXIT_FAILURE;
     }
 
+    options.engine = dictionary_engine == "map" ? DictionaryEngine::Map : DictionaryEngine::Flat;
+    options.stats = &stats;
+
+    // the input expected is what is read: the files archived, or the file compressed, decompressed or verified
+    std::unique_ptr<ProgressDisplay> progress_display;
+
+    if (progress && m != Mode::Train && m != Mode::List)
+    {
+        std::uint64_t total {0};
+
+        if (m == Mode::Archive)
+            for (std::size_t f = 1; f < files.size(); ++f)
+                total += file_size(files[f]);
+        else
+        if (m != Mode::Extract)
+            total = file_size(files[0]);
+
+        progress_display.reset(new ProgressDisplay(total));
+        stats.progress = progress_display.get();
+    }
+
+    // `--threads' alone asks for blocks, which a seed cannot be combined with
+    if (threads_given && !block_size_given && seed_path.empty() && options.block_size == 0)
+        options.block_size = default_block_size;
+
+    // nor with the blocks of a level, which it replaces
+    if (!seed_path.empty() && !block_size_given)
+        options.block_size = 0;
+
+    if (max_memory != 0)
+    {
+        // the buffers of the rings of `--pipeline', and the requests of `--async-io', are off the budget of the codec
+        const std::uint64_t pipeline_memory {
+            m != Mode::Compress ? 0 :
+            pipeline ? std::uint64_t {8} * 1024 * 1024 :
+            async_io ? std::uint64_t {2} * async_buffers * async_buffer_size : 0
+        };
+
+        try
+        {
+            if (max_memory <= pipeline_memory)
+                throw std::invalid_argument("memory budget too small");
+
+            options = m == Mode::Archive ? fit_archive_memory(options, max_memory - pipeline_memory)
+                                         : fit_memory(options, max_memory - pipeline_memory);
+        }
+        catch (const std::invalid_argument &)
+        {
+            print_usage("`--max-memory' is too small to compress in.", false);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (m == Mode::Train)
+        return run_train(files, seed_size);
+
+    // the seed is the one compressing, or the one decompressing finds by its ID
+    std::shared_ptr<const SeedDictionary> seed;
+
+    if (!seed_path.empty())
+    {
+        std::ifstream seed_file(seed_path, std::ios_base::binary);
+
+        if (!seed_file.is_open())
+        {
+            print_usage(std::string("seed_file `") + seed_path + "' could not be opened.");
+            return EXIT_FAILURE;
+        }
+
+        try
+        {
+            seed = std::make_shared<const SeedDictionary>(SeedDictionary::load(seed_file));
+        }
+        catch (const std::exception &e)
+        {
+            print_usage(std::string("Caught exception: ") + e.what() + '.', false);
+            return EXIT_FAILURE;
+        }
+
+        add_seed_dictionary(seed);
+        options.seed = seed.get();
+    }
+
+    if (m == Mode::Archive || m == Mode::List || m == Mode::Extract)
+        return run_archive(m == Mode::Archive ? "archive" : m == Mode::List ? "list" : "extract", files, options, report);
+
+    const std::string operation {m == Mode::Compress ? "compress" : m == Mode::Decompress ? "decompress" : "verify"};
+    const std::string input_path {files[0]};
+    const std::string output_path {m == Mode::Verify ? std::string() : files[1]};
+
+    // `-' is the standard input or output, and the messages then go to the standard error output
+    const bool standard_input {input_path == "-"};
+    const bool standard_output {output_path == "-"};
+    const std::string input_name {standard_input ? "<stdin>" : input_path};
+    std::ostream &messages = standard_output ? std::cerr : std::cout;
+
+    if (mmap && (standard_input || standard_output))
+    {
+        print_usage("`--mmap' needs files, not `-'.");
+        return EXIT_FAILURE;
+    }
+
+    if (standard_input || standard_output)
+        use_standard_streams();
+
+    if (m == Mode::Verify)
+    {
+        try
+        {
+            bool checked;
+
+            if (mmap)
+            {
+                const MappedFile input(input_path);
+
+                checked = verify(input.data(), input.size(), options.threads, &stats);
+            }
+            else
+            {
+                std::ifstream input_file;
+                std::unique_ptr<std::streambuf> async_input;
+
+                if (!standard_input)
+                {
+                    if (async_io)
+                        async_input = open_async_input(input_path);
+                    else
+                        input_file.open(input_path, std::ios_base::binary);
+
+                    if (!async_input && !input_file.is_open())
+                    {
+                        print_usage(std::string("input_file `") + input_path + "' could not be opened.");
+                        return EXIT_FAILURE;
+                    }
+                }
+
+                std::streambuf &source = standard_input ? *std::cin.rdbuf() : async_input ? *async_input : *input_file.rdbuf();
+                std::unique_ptr<ReadAheadStreambuf> read_ahead;
+                std::istream input(&source);
+
+                if (pipeline || (async_io && standard_input))
+                {
+                    read_ahead.reset(new ReadAheadStreambuf(source));
+                    input.rdbuf(read_ahead.get());
+                }
+
+                input.exceptions(std::ios_base::badbit);
+                checked = verify(input, options.threads, &stats);
+            }
+
+            if (!checked)
+                messages << "The file " << input_name << " has no checksums, only its codes could be checked.\n";
+
+            print_result(operation, input_name, stats, report, messages);
+        }
+        catch (const std::ios_base::failure &f)
+        {
+            print_usage(std::string("File input/output failure: ") + f.what() + '.', false);
+            return EXIT_FAILURE;
+        }
+        catch (const std::exception &e)
+        {
+            print_usage(std::string("Caught exception: ") + e.what() + '.', false);
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (mmap)
+    {
+        try
+        {
+            const MappedFile input(input_path);
+
+            if (m == Mode::Compress)
+            {
+                std::ofstream output_file(output_path, std::ios_base::binary);
+
+                if (!output_file.is_open())
+                {
+                    print_usage(std::string("output_file `") + output_path + "' could not be opened.");
+                    return EXIT_FAILURE;
+                }
+
+                output_file.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+                compress(input.data(), input.size(), output_file, options);
+                output_file.close();
+            }
+            else
+            {
+                std::uint64_t original_size;
+
+                if (recorded_size(input.data(), input.size(), original_size))
+                {
+                    // the blocks are decoded straight into the mapped output file
+                    MappedFile output(output_path, original_size);
+
+                    decompress(input.data(), input.size(), output.data(), output.size(), options.threads, &stats);
+                }
+                else
+                {
+                    std::ofstream output_file(output_path, std::ios_base::binary);
+
+                    if (!output_file.is_open())
+                    {
+                        print_usage(std::string("output_file `") + output_path + "' could not be opened.");
+                        return EXIT_FAILURE;
+                    }
+
+                    output_file.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+                    decompress(input.data(), input.size(), output_file, options.threads, &stats);
+                }
+            }
+
+            print_result(operation, input_name, stats, report, messages);
+        }
+        catch (const std::ios_base::failure &f)
+        {
+            print_usage(std::string("File input/output failure: ") + f.what() + '.', false);
+            return EXIT_FAILURE;
+        }
+        catch (const std::exception &e)
+        {
+            print_usage(std::string("Caught exception: ") + e.what() + '.', false);
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+
+    std::ifstream input_file;
+    std::ofstream output_file;
+
+    // with `--async-io', the files are read and written with requests in flight rather than through `std::filebuf'
+    std::unique_ptr<std::streambuf> async_input;
+    std::unique_ptr<std::streambuf> async_output;
+
+    if (!standard_input)
+    {
+        if (async_io)
+            async_input = open_async_input(input_path);
+        else
+            input_file.open(input_path, std::ios_base::binary);
+
+        if (!async_input && !input_file.is_open())
+        {
+            print_usage(std::string("input_file `") + input_path + "' could not be opened.");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!standard_output)
+    {
+        if (async_io)
+            async_output = open_async_output(output_path);
+        else
+            output_file.open(output_path, std::ios_base::binary);
+
+        if (!async_output && !output_file.is_open())
+        {
+            print_usage(std::string("output_file `") + output_path + "' could not be opened.");
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::streambuf &source = standard_input ? *std::cin.rdbuf() : async_input ? *async_input : *input_file.rdbuf();
+    std::streambuf &sink = standard_output ? *std::cout.rdbuf() : async_output ? *async_output : *output_file.rdbuf();
+
 
     try
     {
         input_file.exceptions(std::ios_base::badbit);
         output_file.exceptions(std::ios_base::badbit | std::ios_base::failbit);
 
-        if (m == Mode::Compress) {
-            compress(input_file, output_file);
+        // with `--pipeline', the codec works while threads of their own read and write the files,
+        // and with `--async-io' too for the standard streams, which cannot take requests in flight
+        std::unique_ptr<ReadAheadStreambuf> read_ahead;
+        std::unique_ptr<WriteBehindStreambuf> write_behind;
+        std::istream input(&source);
+        std::ostream output(&sink);
 
-            input_file.close();
-            output_file.close();
+        if (pipeline || (async_io && standard_input))
+        {
+            read_ahead.reset(new ReadAheadStreambuf(source));
+            input.rdbuf(read_ahead.get());
+        }
 
-            input_file.open(argv[2], std::ios_base::binary);
-            input_file.seekg(0, std::ios_base::end);
-            unsigned long InSize = input_file.tellg();
-            input_file.close();
+        if (pipeline || (async_io && standard_output))
+        {
+            write_behind.reset(new WriteBehindStreambuf(sink));
+            output.rdbuf(write_behind.get());
+        }
 
-            input_file.open(argv[3], std::ios_base::binary);
-            input_file.seekg(0, std::ios_base::end);
-            unsigned long OutSize = input_file.tellg();
+        input.exceptions(std::ios_base::badbit);
+        output.exceptions(std::ios_base::badbit | std::ios_base::failbit);
 
-            std::cout << "The file " << argv[2] << " is compressed by  " << 100 - InSize * 10 / OutSize << "%\n";
+        if (m == Mode::Compress) {
+            compress(input, output, options);
         }
         else
         if (m == Mode::Decompress) {
-            decompress(input_file, output_file);
-            std::cout << "The file " << argv[2] << " is decompressed."  << "\n";
+            if (range)
+                decompress_range(input, output, range_offset, range_length, options.threads, &stats);
+            else
+                decompress(input, output, options.threads, &stats);
         }
+
+        // waits for the writer thread or the writes in flight, reporting a failed write
+        output.flush();
+        write_behind.reset();
+
+        if (output_file.is_open())
+            output_file.close();
+
+        print_result(operation, input_name, stats, report, messages);
     }
     catch (const std::ios_base::failure &f)
     {
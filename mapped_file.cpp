@@ -0,0 +1,192 @@
+#include "mapped_file.h"
+
+#include <limits>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path):
+    data_ {nullptr},
+    size_ {0},
+    file_ {INVALID_HANDLE_VALUE},
+    mapping_ {nullptr}
+{
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    LARGE_INTEGER size;
+
+    if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size))
+    {
+        close();
+        throw std::runtime_error("file `" + path + "' could not be opened");
+    }
+
+    if (static_cast<std::uint64_t> (size.QuadPart) > std::numeric_limits<std::size_t>::max())
+    {
+        close();
+        throw std::runtime_error("file `" + path + "' is too large to be mapped");
+    }
+
+    size_ = static_cast<std::size_t> (size.QuadPart);
+    map(path, false);
+}
+
+
+MappedFile::MappedFile(const std::string &path, std::uint64_t size):
+    data_ {nullptr},
+    size_ {0},
+    file_ {INVALID_HANDLE_VALUE},
+    mapping_ {nullptr}
+{
+    if (size > std::numeric_limits<std::size_t>::max())
+        throw std::runtime_error("file `" + path + "' is too large to be mapped");
+
+    file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file_ == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("file `" + path + "' could not be created");
+
+    size_ = static_cast<std::size_t> (size);
+    map(path, true);
+}
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+void MappedFile::close()
+{
+    if (data_ != nullptr)
+        UnmapViewOfFile(data_);
+
+    if (mapping_ != nullptr)
+        CloseHandle(mapping_);
+
+    if (file_ != INVALID_HANDLE_VALUE)
+        CloseHandle(file_);
+
+    data_ = nullptr;
+    mapping_ = nullptr;
+    file_ = INVALID_HANDLE_VALUE;
+}
+
+
+void MappedFile::map(const std::string &path, bool writable)
+{
+    if (size_ == 0)
+        return;
+
+    const std::uint64_t size {size_};
+
+    mapping_ = CreateFileMappingA(file_, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                  static_cast<DWORD> (size >> 32), static_cast<DWORD> (size), nullptr);
+
+    if (mapping_ != nullptr)
+        data_ = static_cast<char *> (MapViewOfFile(mapping_, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size_));
+
+    if (data_ == nullptr)
+    {
+        close();
+        throw std::runtime_error("file `" + path + "' could not be mapped");
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path):
+    data_ {nullptr},
+    size_ {0},
+    fd_ {::open(path.c_str(), O_RDONLY)}
+{
+    struct stat status;
+
+    if (fd_ == -1 || ::fstat(fd_, &status) != 0)
+    {
+        close();
+        throw std::runtime_error("file `" + path + "' could not be opened");
+    }
+
+    if (static_cast<std::uint64_t> (status.st_size) > std::numeric_limits<std::size_t>::max())
+    {
+        close();
+        throw std::runtime_error("file `" + path + "' is too large to be mapped");
+    }
+
+    size_ = static_cast<std::size_t> (status.st_size);
+    map(path, false);
+}
+
+
+MappedFile::MappedFile(const std::string &path, std::uint64_t size):
+    data_ {nullptr},
+    size_ {0},
+    fd_ {::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666)}
+{
+    if (fd_ == -1 || size > std::numeric_limits<std::size_t>::max()
+        || ::ftruncate(fd_, static_cast<off_t> (size)) != 0)
+    {
+        close();
+        throw std::runtime_error("file `" + path + "' could not be created");
+    }
+
+    size_ = static_cast<std::size_t> (size);
+    map(path, true);
+}
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+void MappedFile::close()
+{
+    if (data_ != nullptr)
+        ::munmap(data_, size_);
+
+    if (fd_ != -1)
+        ::close(fd_);
+
+    data_ = nullptr;
+    fd_ = -1;
+}
+
+
+void MappedFile::map(const std::string &path, bool writable)
+{
+    if (size_ == 0)
+        return;
+
+    void * const p {::mmap(nullptr, size_, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                           writable ? MAP_SHARED : MAP_PRIVATE, fd_, 0)};
+
+    if (p == MAP_FAILED)
+    {
+        close();
+        throw std::runtime_error("file `" + path + "' could not be mapped");
+    }
+
+    data_ = static_cast<char *> (p);
+
+    // both directions go through the file front to back, or nearly so
+    ::madvise(data_, size_, MADV_SEQUENTIAL);
+}
+
+#endif
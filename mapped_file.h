@@ -0,0 +1,71 @@
+#ifndef MEGALZW_MAPPED_FILE_H
+#define MEGALZW_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+/**
+     * A whole file mapped into memory.
+     *
+     * Opening a file maps it read-only; creating one sets its size first and
+     * maps it writable, so that it can be filled in any order. An empty file
+     * is not mapped at all, `data()` is then a null pointer.
+*/
+class MappedFile
+{
+public:
+
+    /**
+     * Maps the existing file at `path` for reading.
+     *
+     * @param path     file name
+     * @throw std::runtime_error if the file cannot be opened or mapped
+    */
+    explicit MappedFile(const std::string &path);
+
+    /**
+     * Creates, or truncates, the file at `path` with a size of `size` bytes
+     * and maps it for writing.
+     *
+     * @param path     file name
+     * @param size     size of the file
+     * @throw std::runtime_error if the file cannot be created or mapped
+    */
+    MappedFile(const std::string &path, std::uint64_t size);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    char *data() const
+    {
+        return data_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+private:
+
+    void map(const std::string &path, bool writable);
+
+    /// Unmaps and closes whatever is mapped and open.
+    void close();
+
+    char *data_;
+    std::size_t size_;
+
+#ifdef _WIN32
+    void *file_;
+    void *mapping_;
+#else
+    int fd_;
+#endif
+};
+
+#endif // MEGALZW_MAPPED_FILE_H
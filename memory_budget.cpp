@@ -0,0 +1,136 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "codec.h"
+#include "parallel.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+namespace {
+
+/// Chunks of the streams read and written, and other buffers of a call, rounded up.
+const std::uint64_t io_memory {1024 * 1024};
+
+/// Block size the blocks are made smaller down to before anything else is given up.
+const std::size_t large_block_size {1024 * 1024};
+
+/// Smallest block size `fit_memory()` picks.
+const std::size_t min_fitted_block_size {64 * 1024};
+
+/// Narrowest code width `supported_code_width()` accepts.
+const unsigned int narrowest_code_width {12};
+
+} // namespace
+
+
+std::uint64_t compress_memory(const Options &options)
+{
+    const std::uint64_t encoder {encoder_storage(options)};
+
+    if (options.block_size == 0)
+        return encoder + io_memory;
+
+    const std::uint64_t threads {thread_count(options.threads)};
+
+    // a block, and its codes when there are as many as bytes
+    const std::uint64_t block {options.block_size + std::uint64_t {options.block_size} * options.bits / 8 + 8};
+
+    return threads * encoder + 2 * threads * block + io_memory;
+}
+
+
+Options fit_memory(const Options &options, std::uint64_t budget)
+{
+    Options fitted {options};
+
+    if (fitted.block_size != 0)
+        fitted.threads = thread_count(fitted.threads);
+
+    while (compress_memory(fitted) > budget)
+    {
+        if (fitted.block_size > large_block_size)
+            fitted.block_size = std::max(fitted.block_size / 2, large_block_size);
+        else
+        if (fitted.bits > default_code_width)
+            fitted.bits -= 4;
+        else
+        if (fitted.block_size != 0 && fitted.threads > 1)
+            --fitted.threads;
+        else
+        if (fitted.block_size > min_fitted_block_size)
+            fitted.block_size = std::max(fitted.block_size / 2, min_fitted_block_size);
+        else
+        if (fitted.bits > narrowest_code_width)
+            fitted.bits -= 4;
+        else
+            throw std::invalid_argument("memory budget too small");
+    }
+
+    return fitted;
+}
+
+
+std::uint64_t archive_memory(const Options &options)
+{
+    const std::uint64_t threads {thread_count(options.threads)};
+
+    return threads * (encoder_storage(options) + io_memory);
+}
+
+
+Options fit_archive_memory(const Options &options, std::uint64_t budget)
+{
+    Options fitted {options};
+
+    fitted.threads = thread_count(fitted.threads);
+
+    while (archive_memory(fitted) > budget)
+    {
+        if (fitted.bits > default_code_width)
+            fitted.bits -= 4;
+        else
+        if (fitted.threads > 1)
+            --fitted.threads;
+        else
+        if (fitted.bits > narrowest_code_width)
+            fitted.bits -= 4;
+        else
+            throw std::invalid_argument("memory budget too small");
+    }
+
+    return fitted;
+}
+
+
+std::uint64_t peak_memory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters))
+        return 0;
+
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+#ifdef __APPLE__
+    return static_cast<std::uint64_t> (usage.ru_maxrss);
+#else
+    // in kilobytes
+    return static_cast<std::uint64_t> (usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
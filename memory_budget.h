@@ -0,0 +1,65 @@
+#ifndef MEGALZW_MEMORY_BUDGET_H
+#define MEGALZW_MEMORY_BUDGET_H
+
+#include <cstdint>
+
+#include "lzw.h"
+
+
+/**
+     * Memory budgets: how much compressing takes with given settings, the
+     * settings that keep it under a limit, and how much the process took.
+     *
+     * The estimates are upper bounds on what the codec allocates: a full
+     * dictionary per thread, the blocks in flight and their compressed
+     * output as large as one code per byte makes it. Whole inputs read into
+     * memory, for `Options::bmp_filter` or after mapping a file, are not
+     * counted, nor are the compressed members of an archive.
+*/
+
+/**
+     * Returns the bytes `compress()` takes at most with `options`.
+     *
+     * A single code stream takes one encoder; blocks take one per thread,
+     * and twice as many blocks in flight as threads, each read into a
+     * buffer and compressed into another.
+     *
+     * @param options      code width, dictionary engine, reset policy, block size and threads
+*/
+std::uint64_t compress_memory(const Options &options);
+
+/**
+     * Returns `options` with settings that make `compress_memory()` at most `budget`.
+     *
+     * What is given up first is what costs the least ratio: blocks larger
+     * than 1 MiB, then codes wider than the default, then threads, then
+     * blocks down to 64 KiB, then codes down to 12 bits. The number of
+     * threads of the result is explicit, never 0.
+     *
+     * @param options      settings to start from
+     * @param budget       bytes compressing may take
+     * @throw std::invalid_argument if even the smallest settings take more
+*/
+Options fit_memory(const Options &options, std::uint64_t budget);
+
+/**
+     * Returns the bytes `create_archive()` takes at most with `options`: an
+     * encoder per thread, the members being compressed each as a single code stream.
+*/
+std::uint64_t archive_memory(const Options &options);
+
+/**
+     * Like `fit_memory()`, for `archive_memory()`: codes are made narrower
+     * down to the default width, then threads fewer, then codes down to 12 bits.
+     *
+     * @throw std::invalid_argument if even the smallest settings take more than `budget`
+*/
+Options fit_archive_memory(const Options &options, std::uint64_t budget);
+
+/**
+     * Returns the peak resident memory of the process so far, in bytes, or 0
+     * if the system does not tell.
+*/
+std::uint64_t peak_memory();
+
+#endif // MEGALZW_MEMORY_BUDGET_H
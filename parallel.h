@@ -0,0 +1,82 @@
+#ifndef MEGALZW_PARALLEL_H
+#define MEGALZW_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/// Returns `threads`, or the number of hardware threads if it is 0.
+inline unsigned int thread_count(unsigned int threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+
+    return std::max(threads, 1u);
+}
+
+
+/**
+     * Calls `f(i)` for every `i` from 0 to `count - 1`, on up to `threads` threads.
+     *
+     * Threads take the next index as soon as they are done with one, so
+     * uneven work spreads out by itself. The first exception thrown by `f`
+     * is rethrown once every thread has stopped.
+     *
+     * @param count    number of calls
+     * @param threads  maximum number of threads, 0 for one per hardware thread
+     * @param f        function object taking a `std::size_t`
+*/
+template <typename F>
+void parallel_for(std::size_t count, unsigned int threads, F f)
+{
+    threads = static_cast<unsigned int> (std::min<std::size_t> (thread_count(threads), count));
+
+    if (threads <= 1)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            f(i);
+
+        return;
+    }
+
+    std::atomic<std::size_t> next {0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    const auto work = [&] {
+        try
+        {
+            for (std::size_t i; (i = next++) < count; )
+                f(i);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+
+            if (!error)
+                error = std::current_exception();
+
+            next = count;
+        }
+    };
+
+    std::vector<std::thread> pool;
+
+    for (unsigned int t = 1; t < threads; ++t)
+        pool.emplace_back(work);
+
+    work();
+
+    for (std::thread &t : pool)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+#endif // MEGALZW_PARALLEL_H
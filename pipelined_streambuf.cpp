@@ -0,0 +1,297 @@
+#include "pipelined_streambuf.h"
+
+
+BufferRing::BufferRing(std::size_t buffers, std::size_t buffer_size):
+    buffers_(buffers, std::vector<char>(buffer_size)),
+    sizes_(buffers),
+    first_ {0},
+    full_ {0},
+    closed_ {false},
+    stopped_ {false}
+{
+}
+
+
+std::vector<char> *BufferRing::acquire_empty()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    changed_.wait(lock, [this] { return full_ < buffers_.size() || stopped_; });
+    return stopped_ ? nullptr : &buffers_[(first_ + full_) % buffers_.size()];
+}
+
+
+void BufferRing::push(std::size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    sizes_[(first_ + full_) % buffers_.size()] = size;
+    ++full_;
+    changed_.notify_all();
+}
+
+
+void BufferRing::close()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    closed_ = true;
+    changed_.notify_all();
+}
+
+
+std::vector<char> *BufferRing::acquire_full(std::size_t &size)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    changed_.wait(lock, [this] { return full_ > 0 || closed_ || stopped_; });
+
+    if (full_ == 0 || stopped_)
+        return nullptr;
+
+    size = sizes_[first_];
+    return &buffers_[first_];
+}
+
+
+void BufferRing::pop()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    first_ = (first_ + 1) % buffers_.size();
+    --full_;
+    changed_.notify_all();
+}
+
+
+void BufferRing::drain()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    changed_.wait(lock, [this] { return full_ == 0 || stopped_; });
+}
+
+
+void BufferRing::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    stopped_ = true;
+    changed_.notify_all();
+}
+
+
+void BufferRing::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    first_ = 0;
+    full_ = 0;
+    closed_ = false;
+    stopped_ = false;
+}
+
+
+ReadAheadStreambuf::ReadAheadStreambuf(std::streambuf &source, std::size_t buffers, std::size_t buffer_size):
+    source_(source),
+    ring_(buffers, buffer_size),
+    reading_ {false},
+    position_ {source.pubseekoff(0, std::ios_base::cur, std::ios_base::in)}
+{
+}
+
+
+ReadAheadStreambuf::~ReadAheadStreambuf()
+{
+    stop();
+}
+
+
+/**
+     * Starts the thread on the first read after construction or a seek,
+     * lets go of the buffer the get area was, and waits for the next one.
+*/
+ReadAheadStreambuf::int_type ReadAheadStreambuf::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    if (reading_)
+    {
+        if (position_ != pos_type(off_type(-1)))
+            position_ += egptr() - eback();
+
+        setg(nullptr, nullptr, nullptr);
+        reading_ = false;
+        ring_.pop();
+    }
+
+    if (!reader_.joinable())
+        reader_ = std::thread(&ReadAheadStreambuf::read, this);
+
+    std::size_t size;
+    std::vector<char> * const buffer {ring_.acquire_full(size)};
+
+    if (buffer == nullptr)
+    {
+        if (error_)
+            std::rethrow_exception(error_);
+
+        return traits_type::eof();
+    }
+
+    setg(buffer->data(), buffer->data(), buffer->data() + size);
+    reading_ = true;
+
+    // a short read is the end of `source_`, an empty one has nothing to return
+    return size == 0 ? traits_type::eof() : traits_type::to_int_type(*gptr());
+}
+
+
+ReadAheadStreambuf::pos_type ReadAheadStreambuf::seekoff(off_type off, std::ios_base::seekdir dir,
+                                                         std::ios_base::openmode which)
+{
+    const pos_type unknown {off_type(-1)};
+
+    if (dir == std::ios_base::cur)
+    {
+        // the thread has read past the position of the reader
+        if (position_ == unknown)
+            return unknown;
+
+        const pos_type current {position_ + off_type(gptr() - eback())};
+
+        if (off == 0)
+            return current;
+
+        return seekpos(current + off, which);
+    }
+
+    stop();
+    position_ = source_.pubseekoff(off, dir, which);
+    return position_;
+}
+
+
+ReadAheadStreambuf::pos_type ReadAheadStreambuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    stop();
+    position_ = source_.pubseekpos(pos, which);
+    return position_;
+}
+
+
+void ReadAheadStreambuf::read()
+{
+    try
+    {
+        for (std::vector<char> *buffer; (buffer = ring_.acquire_empty()) != nullptr; )
+        {
+            const std::size_t size {static_cast<std::size_t> (
+                source_.sgetn(buffer->data(), static_cast<std::streamsize> (buffer->size())))};
+
+            ring_.push(size);
+
+            if (size < buffer->size())
+                break;
+        }
+    }
+    catch (...)
+    {
+        error_ = std::current_exception();
+    }
+
+    ring_.close();
+}
+
+
+void ReadAheadStreambuf::stop()
+{
+    ring_.stop();
+
+    if (reader_.joinable())
+        reader_.join();
+
+    ring_.reset();
+    error_ = nullptr;
+    setg(nullptr, nullptr, nullptr);
+    reading_ = false;
+}
+
+
+WriteBehindStreambuf::WriteBehindStreambuf(std::streambuf &target, std::size_t buffers, std::size_t buffer_size):
+    target_(target),
+    ring_(buffers, buffer_size),
+    failed_ {false}
+{
+    std::vector<char> * const buffer {ring_.acquire_empty()};
+
+    setp(buffer->data(), buffer->data() + buffer->size());
+    writer_ = std::thread(&WriteBehindStreambuf::write, this);
+}
+
+
+WriteBehindStreambuf::~WriteBehindStreambuf()
+{
+    ring_.push(static_cast<std::size_t> (pptr() - pbase()));
+    ring_.close();
+    writer_.join();
+}
+
+
+WriteBehindStreambuf::int_type WriteBehindStreambuf::overflow(int_type c)
+{
+    if (failed_)
+        return traits_type::eof();
+
+    hand_off();
+
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(c);
+}
+
+
+int WriteBehindStreambuf::sync()
+{
+    hand_off();
+    ring_.drain();
+
+    return failed_ ? -1 : target_.pubsync();
+}
+
+
+void WriteBehindStreambuf::write()
+{
+    std::size_t size;
+
+    for (std::vector<char> *buffer; (buffer = ring_.acquire_full(size)) != nullptr; ring_.pop())
+    {
+        if (failed_)
+            continue;
+
+        try
+        {
+            if (target_.sputn(buffer->data(), static_cast<std::streamsize> (size)) != static_cast<std::streamsize> (size))
+                failed_ = true;
+        }
+        catch (...)
+        {
+            failed_ = true;
+        }
+    }
+}
+
+
+void WriteBehindStreambuf::hand_off()
+{
+    ring_.push(static_cast<std::size_t> (pptr() - pbase()));
+
+    std::vector<char> * const buffer {ring_.acquire_empty()};
+
+    setp(buffer->data(), buffer->data() + buffer->size());
+}
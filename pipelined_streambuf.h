@@ -0,0 +1,158 @@
+#ifndef MEGALZW_PIPELINED_STREAMBUF_H
+#define MEGALZW_PIPELINED_STREAMBUF_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+
+/**
+     * Buffers handed from one thread to another in order, for the stream
+     * buffers below: the producer fills the empty buffer after the full
+     * ones, and the consumer empties the first full one.
+*/
+class BufferRing
+{
+public:
+
+    BufferRing(std::size_t buffers, std::size_t buffer_size);
+
+    BufferRing(const BufferRing &) = delete;
+    BufferRing &operator=(const BufferRing &) = delete;
+
+    /// Waits for an empty buffer for the producer, and returns it, or null once the ring is stopped.
+    std::vector<char> *acquire_empty();
+
+    /// Makes the buffer of `acquire_empty()`, filled with `size` bytes, the last full one.
+    void push(std::size_t size);
+
+    /// Ends the full buffers: once they are emptied, `acquire_full()` returns null.
+    void close();
+
+    /**
+     * Waits for a full buffer for the consumer, and returns it, or null once
+     * the ring is closed and every buffer emptied, or stopped.
+     *
+     * @param [out] size   number of bytes in the buffer
+    */
+    std::vector<char> *acquire_full(std::size_t &size);
+
+    /// Makes the buffer of `acquire_full()` empty again.
+    void pop();
+
+    /// Waits until every full buffer has been emptied, or the ring is stopped.
+    void drain();
+
+    /// Wakes both threads up for good; `acquire_empty()` and `acquire_full()` return null from then on.
+    void stop();
+
+    /// Empties every buffer and undoes `close()` and `stop()`, once neither thread uses the ring.
+    void reset();
+
+private:
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<std::vector<char>> buffers_;
+    std::vector<std::size_t> sizes_;
+    std::size_t first_;     ///< first full buffer
+    std::size_t full_;      ///< number of full buffers, the one being emptied included
+    bool closed_;
+    bool stopped_;
+};
+
+
+/**
+     * Stream buffer reading ahead of its reader, on a thread of its own,
+     * from another stream buffer.
+     *
+     * While the codec works on one buffer of the ring, the thread fills the
+     * next ones, so that waiting for the disk and compressing overlap.
+     * Seeking stops the thread, drops what it read ahead and seeks `source`;
+     * reading starts over from there.
+*/
+class ReadAheadStreambuf: public std::streambuf
+{
+public:
+
+    /**
+     * @param source       stream buffer read from; only this one reads it from then on
+     * @param buffers      number of buffers of the ring
+     * @param buffer_size  bytes read from `source` at a time
+    */
+    explicit ReadAheadStreambuf(std::streambuf &source, std::size_t buffers = 4,
+                                std::size_t buffer_size = 1024 * 1024);
+    ~ReadAheadStreambuf();
+
+protected:
+
+    int_type underflow() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+private:
+
+    /// Body of the thread.
+    void read();
+
+    /// Stops the thread and drops what it read.
+    void stop();
+
+    std::streambuf &source_;
+    BufferRing ring_;
+    std::thread reader_;
+    std::exception_ptr error_;  ///< what `source_` threw, rethrown once the buffers before are read
+    bool reading_;              ///< whether the get area is a buffer of the ring
+    pos_type position_;         ///< position in `source_` of the start of the get area, -1 if unknown
+};
+
+
+/**
+     * Stream buffer writing behind its writer, on a thread of its own, to
+     * another stream buffer.
+     *
+     * The writer fills one buffer of the ring while the thread writes the
+     * ones before. A failed write is reported by the next `overflow()` or
+     * `sync()`, so flushing the stream before destroying the buffer is what
+     * makes sure that everything was written.
+*/
+class WriteBehindStreambuf: public std::streambuf
+{
+public:
+
+    /**
+     * @param target       stream buffer written to; only this one writes it from then on
+     * @param buffers      number of buffers of the ring
+     * @param buffer_size  bytes written to `target` at a time
+    */
+    explicit WriteBehindStreambuf(std::streambuf &target, std::size_t buffers = 4,
+                                  std::size_t buffer_size = 1024 * 1024);
+
+    /// Writes what is left, without reporting errors.
+    ~WriteBehindStreambuf();
+
+protected:
+
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+private:
+
+    /// Body of the thread.
+    void write();
+
+    /// Hands the put area to the thread, and makes the next empty buffer the put area.
+    void hand_off();
+
+    std::streambuf &target_;
+    BufferRing ring_;
+    std::thread writer_;
+    std::atomic<bool> failed_;  ///< whether `target_` wrote fewer bytes than it was given
+};
+
+#endif // MEGALZW_PIPELINED_STREAMBUF_H
@@ -0,0 +1,57 @@
+#include "progress.h"
+
+#include <algorithm>
+
+
+ProgressObserver::ProgressObserver(std::uint64_t total, std::uint64_t interval):
+    total_ {total},
+    interval_ {std::max<std::uint64_t> (interval, 1)},
+    start_ {std::chrono::steady_clock::now()},
+    bytes_ {0},
+    next_ {interval_},
+    notifying_ {false}
+{
+}
+
+
+void ProgressObserver::finish()
+{
+    // the threads of the call are done, but one may still be notifying the observer
+    while (notifying_.exchange(true, std::memory_order_acquire))
+        ;
+
+    notify(progress(bytes(), true));
+    notifying_.store(false, std::memory_order_release);
+}
+
+
+void ProgressObserver::notify_interval(std::uint64_t done)
+{
+    // a thread already notifying the observer makes this notification unneeded
+    if (notifying_.exchange(true, std::memory_order_acquire))
+        return;
+
+    if (done >= next_.load(std::memory_order_relaxed))
+    {
+        next_.store(done + interval_, std::memory_order_relaxed);
+        notify(progress(done, false));
+    }
+
+    notifying_.store(false, std::memory_order_release);
+}
+
+
+Progress ProgressObserver::progress(std::uint64_t done, bool finished) const
+{
+    const double seconds {std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count()};
+    const double rate {seconds > 0 ? done / seconds : 0};
+
+    return Progress {
+        done,
+        total_,
+        seconds,
+        rate / (1024 * 1024),
+        finished ? 0 : total_ == 0 ? -1 : rate > 0 ? (total_ - std::min(done, total_)) / rate : -1,
+        finished
+    };
+}
@@ -0,0 +1,112 @@
+#ifndef MEGALZW_PROGRESS_H
+#define MEGALZW_PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+/// Bytes of input between two notifications of a `ProgressObserver` when none is asked for.
+const std::uint64_t default_progress_interval {16 * 1024 * 1024};
+
+
+/// What a `ProgressObserver` is notified of.
+struct Progress
+{
+    /// Bytes of input processed so far.
+    std::uint64_t bytes;
+
+    /// Bytes of input expected in all, 0 if unknown.
+    std::uint64_t total;
+
+    /// Seconds since the observer was created.
+    double seconds;
+
+    /// Average throughput so far, in MB (2^20 bytes) of input per second.
+    double megabytes_per_second;
+
+    /// Seconds left at that throughput, negative if the total is unknown.
+    double eta_seconds;
+
+    /// Whether the call is done, which is the last notification of it.
+    bool done;
+};
+
+
+/**
+     * Observer of the progress of calls of `compress()`, `decompress()` and
+     * `create_archive()`, set in `Stats::progress`.
+     *
+     * The call counts the bytes of input it processes with `advance()`, and
+     * the observer is notified every `interval` bytes, and once more when the
+     * call is done. The count is atomic and no lock is taken: threads may
+     * advance it together, and other threads may read `bytes()` at any time,
+     * such as a scheduler telling stalled workers from slow ones.
+     *
+     * Calls reading streams count their input as they read it. Calls on
+     * input in memory only notify the observer when they are done, but
+     * archives count every member they compress.
+*/
+class ProgressObserver
+{
+public:
+
+    /**
+     * @param total        bytes of input expected, 0 if unknown
+     * @param interval     bytes of input between two notifications
+    */
+    explicit ProgressObserver(std::uint64_t total = 0, std::uint64_t interval = default_progress_interval);
+
+    virtual ~ProgressObserver() = default;
+
+    ProgressObserver(const ProgressObserver &) = delete;
+    ProgressObserver &operator=(const ProgressObserver &) = delete;
+
+    /// Counts `bytes` more bytes of input, and notifies the observer if one more interval is done.
+    void advance(std::uint64_t bytes)
+    {
+        const std::uint64_t done {bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes};
+
+        if (done >= next_.load(std::memory_order_relaxed))
+            notify_interval(done);
+    }
+
+    /// Notifies the observer the call is done.
+    void finish();
+
+    /// Returns the bytes of input counted so far.
+    std::uint64_t bytes() const
+    {
+        return bytes_.load(std::memory_order_relaxed);
+    }
+
+protected:
+
+    /**
+     * Called with the progress every `interval` bytes and when the call is
+     * done, by one thread at a time: that of the call, or one of its threads.
+    */
+    virtual void notify(const Progress &progress) = 0;
+
+private:
+
+    /// Notifies the observer of `done` bytes, unless another thread got there first.
+    void notify_interval(std::uint64_t done);
+
+    /// Returns the progress at `done` bytes.
+    Progress progress(std::uint64_t done, bool finished) const;
+
+    const std::uint64_t total_;
+    const std::uint64_t interval_;
+    const std::chrono::steady_clock::time_point start_;
+
+    std::atomic<std::uint64_t> bytes_;
+
+    /// Bytes from which the next notification is due.
+    std::atomic<std::uint64_t> next_;
+
+    /// Whether a thread is notifying the observer, which the others then skip.
+    std::atomic<bool> notifying_;
+};
+
+#endif // MEGALZW_PROGRESS_H
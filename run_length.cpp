@@ -0,0 +1,34 @@
+#include "run_length.h"
+
+
+#ifdef MEGALZW_RUN_LENGTH_DISPATCH
+
+namespace {
+
+using Kernel = std::size_t (*)(const char *, const char *, char);
+
+/// Returns the kernel of `run_length()` for the best instructions of the processor.
+Kernel best_kernel()
+{
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512bw"))
+        return detail::run_length_avx512;
+
+    if (__builtin_cpu_supports("avx2"))
+        return detail::run_length_avx2;
+
+    return detail::run_length_sse2;
+}
+
+} // namespace
+
+
+std::size_t detail::run_length_dispatch(const char *first, const char *last, char c)
+{
+    static const Kernel kernel {best_kernel()};
+
+    return kernel(first, last, c);
+}
+
+#endif
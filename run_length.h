@@ -0,0 +1,201 @@
+#ifndef MEGALZW_RUN_LENGTH_H
+#define MEGALZW_RUN_LENGTH_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) && !defined(__AVX512BW__) \
+    && !defined(MEGALZW_NO_CPU_DISPATCH)
+// every kernel is compiled for its instructions in a function of its own, the best the processor has is used
+#define MEGALZW_RUN_LENGTH_DISPATCH
+#define MEGALZW_RUN_LENGTH_AVX512
+#define MEGALZW_RUN_LENGTH_AVX2
+#define MEGALZW_RUN_LENGTH_SSE2
+#define MEGALZW_RUN_LENGTH_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#else
+#if defined(__AVX512BW__)
+#define MEGALZW_RUN_LENGTH_AVX512
+#include <immintrin.h>
+#elif defined(__AVX2__)
+#define MEGALZW_RUN_LENGTH_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MEGALZW_RUN_LENGTH_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define MEGALZW_RUN_LENGTH_NEON
+#include <arm_neon.h>
+#endif
+#define MEGALZW_RUN_LENGTH_TARGET(isa)
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace detail {
+
+    /// Returns the number of trailing zero bits of `mask`, which must not be zero.
+    inline unsigned int count_trailing_zeros(std::uint32_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+
+        _BitScanForward(&index, mask);
+        return static_cast<unsigned int> (index);
+#else
+        return static_cast<unsigned int> (__builtin_ctz(mask));
+#endif
+    }
+
+    /// Returns `first - start` plus the number of bytes equal to `c` from `first` to `last`, one at a time.
+    inline std::size_t run_length_bytes(const char *start, const char *first, const char *last, char c)
+    {
+        while (first != last && *first == c)
+            ++first;
+
+        return static_cast<std::size_t> (first - start);
+    }
+
+#ifdef MEGALZW_RUN_LENGTH_AVX512
+    /// Returns the number of trailing zero bits of `mask`, which must not be zero.
+    inline unsigned int count_trailing_zeros64(std::uint64_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+
+        _BitScanForward64(&index, mask);
+        return static_cast<unsigned int> (index);
+#else
+        return static_cast<unsigned int> (__builtin_ctzll(mask));
+#endif
+    }
+
+    /// `run_length()` comparing 64 bytes at a time with AVX-512BW.
+    MEGALZW_RUN_LENGTH_TARGET("avx512bw")
+    inline std::size_t run_length_avx512(const char *first, const char *last, char c)
+    {
+        const char * const start {first};
+        const __m512i pattern {_mm512_set1_epi8(c)};
+
+        for (; last - first >= 64; first += 64)
+        {
+            const std::uint64_t equal {_mm512_cmpeq_epi8_mask(_mm512_loadu_si512(first), pattern)};
+
+            if (equal != ~std::uint64_t {0})
+                return static_cast<std::size_t> (first - start) + count_trailing_zeros64(~equal);
+        }
+
+        return run_length_bytes(start, first, last, c);
+    }
+#endif
+
+#ifdef MEGALZW_RUN_LENGTH_AVX2
+    /// `run_length()` comparing 32 bytes at a time with AVX2.
+    MEGALZW_RUN_LENGTH_TARGET("avx2")
+    inline std::size_t run_length_avx2(const char *first, const char *last, char c)
+    {
+        const char * const start {first};
+        const __m256i pattern {_mm256_set1_epi8(c)};
+
+        for (; last - first >= 32; first += 32)
+        {
+            const __m256i bytes {_mm256_loadu_si256(reinterpret_cast<const __m256i *> (first))};
+            const std::uint32_t equal {static_cast<std::uint32_t> (_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, pattern)))};
+
+            if (equal != 0xffffffff)
+                return static_cast<std::size_t> (first - start) + count_trailing_zeros(~equal);
+        }
+
+        return run_length_bytes(start, first, last, c);
+    }
+#endif
+
+#ifdef MEGALZW_RUN_LENGTH_SSE2
+    /// `run_length()` comparing 16 bytes at a time with SSE2.
+    inline std::size_t run_length_sse2(const char *first, const char *last, char c)
+    {
+        const char * const start {first};
+        const __m128i pattern {_mm_set1_epi8(c)};
+
+        for (; last - first >= 16; first += 16)
+        {
+            const __m128i bytes {_mm_loadu_si128(reinterpret_cast<const __m128i *> (first))};
+            const std::uint32_t equal {static_cast<std::uint32_t> (_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, pattern)))};
+
+            if (equal != 0xffff)
+                return static_cast<std::size_t> (first - start) + count_trailing_zeros(~equal);
+        }
+
+        return run_length_bytes(start, first, last, c);
+    }
+#endif
+
+#ifdef MEGALZW_RUN_LENGTH_NEON
+    /// `run_length()` comparing 16 bytes at a time with NEON.
+    inline std::size_t run_length_neon(const char *first, const char *last, char c)
+    {
+        const char * const start {first};
+        const uint8x16_t pattern {vdupq_n_u8(static_cast<std::uint8_t> (c))};
+
+        for (; last - first >= 16; first += 16)
+        {
+            const uint8x16_t equal {vceqq_u8(vld1q_u8(reinterpret_cast<const std::uint8_t *> (first)), pattern)};
+
+            // all ones unless some byte differs
+            if (vminvq_u8(equal) != 0xff)
+                break;
+        }
+
+        return run_length_bytes(start, first, last, c);
+    }
+#endif
+
+#ifdef MEGALZW_RUN_LENGTH_DISPATCH
+    /// Runs the kernel of `run_length()` for the best instructions of the processor, picked on the first call.
+    std::size_t run_length_dispatch(const char *first, const char *last, char c);
+#endif
+
+} // namespace detail
+
+
+/**
+     * Returns the number of bytes equal to `c` at the start of the bytes from
+     * `first` to `last`.
+     *
+     * Compares 64 bytes at a time with AVX-512BW, 32 with AVX2, 16 with SSE2
+     * or NEON, and the bytes that are left one at a time. On x86-64, GCC and
+     * Clang compile all of them and the processor's best is picked at run
+     * time, unless `MEGALZW_NO_CPU_DISPATCH` is defined; otherwise, and with
+     * other compilers, it is the one the compiler targets.
+*/
+inline std::size_t run_length(const char *first, const char *last, char c)
+{
+    // most of the runs the codec asks about are over at once, which needs no kernel
+    if (first == last || *first != c)
+        return 0;
+
+#if defined(MEGALZW_RUN_LENGTH_DISPATCH)
+    return detail::run_length_dispatch(first, last, c);
+#elif defined(MEGALZW_RUN_LENGTH_AVX512)
+    return detail::run_length_avx512(first, last, c);
+#elif defined(MEGALZW_RUN_LENGTH_AVX2)
+    return detail::run_length_avx2(first, last, c);
+#elif defined(MEGALZW_RUN_LENGTH_SSE2)
+    return detail::run_length_sse2(first, last, c);
+#elif defined(MEGALZW_RUN_LENGTH_NEON)
+    return detail::run_length_neon(first, last, c);
+#else
+    return detail::run_length_bytes(first, first, last, c);
+#endif
+}
+
+#undef MEGALZW_RUN_LENGTH_AVX512
+#undef MEGALZW_RUN_LENGTH_AVX2
+#undef MEGALZW_RUN_LENGTH_SSE2
+#undef MEGALZW_RUN_LENGTH_NEON
+#undef MEGALZW_RUN_LENGTH_TARGET
+
+#endif // MEGALZW_RUN_LENGTH_H
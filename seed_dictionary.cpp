@@ -0,0 +1,223 @@
+#include "seed_dictionary.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "crc32c.h"
+#include "format.h"
+
+
+namespace {
+
+/// Returns the strings of `keys` as a seed dictionary file stores them.
+std::vector<char> stored_keys(const std::vector<std::uint32_t> &keys)
+{
+    std::vector<char> stored(4 * keys.size());
+
+    for (std::size_t n = 0; n < keys.size(); ++n)
+        format::put_u32(&stored[4 * n], keys[n]);
+
+    return stored;
+}
+
+
+/// The seeds added with `add_seed_dictionary()`, by ID.
+struct Registry
+{
+    std::mutex mutex;
+    std::map<std::uint32_t, std::shared_ptr<const SeedDictionary>> seeds;
+};
+
+
+Registry &registry()
+{
+    static Registry seeds;
+
+    return seeds;
+}
+
+} // namespace
+
+
+SeedDictionary::SeedDictionary(std::vector<std::uint32_t> keys):
+    keys_(std::move(keys))
+{
+    if (keys_.size() > max_seed_size)
+        throw std::invalid_argument("too many strings in the seed dictionary");
+
+    for (std::size_t n = 0; n < keys_.size(); ++n)
+        if ((keys_[n] >> 8) >= 256 + n)
+            throw std::invalid_argument("seed dictionary string built on a later one");
+
+    const std::vector<char> stored {stored_keys(keys_)};
+
+    id_ = crc32c(stored.data(), stored.size());
+}
+
+
+SeedDictionary SeedDictionary::load(std::istream &is)
+{
+    char header[format::seed_header_size];
+
+    if (!is.read(header, sizeof header) || std::memcmp(header, format::seed_magic, sizeof format::seed_magic) != 0)
+        throw std::runtime_error("not a seed dictionary");
+
+    if (static_cast<std::uint8_t> (header[4]) != format::seed_version)
+        throw std::runtime_error("unsupported seed dictionary version");
+
+    const std::uint32_t size {format::get_u32(header + 5)};
+
+    if (size > max_seed_size)
+        throw std::runtime_error("corrupted seed dictionary");
+
+    std::vector<char> stored(4 * static_cast<std::size_t> (size) + 4);
+
+    if (!is.read(stored.data(), static_cast<std::streamsize> (stored.size())))
+        throw std::runtime_error("corrupted seed dictionary");
+
+    std::vector<std::uint32_t> keys(size);
+
+    for (std::size_t n = 0; n < keys.size(); ++n)
+    {
+        keys[n] = format::get_u32(&stored[4 * n]);
+
+        if ((keys[n] >> 8) >= 256 + n)
+            throw std::runtime_error("corrupted seed dictionary");
+    }
+
+    SeedDictionary seed(std::move(keys));
+
+    if (seed.id() != format::get_u32(&stored[4 * static_cast<std::size_t> (size)]))
+        throw std::runtime_error("corrupted seed dictionary");
+
+    return seed;
+}
+
+
+void SeedDictionary::save(std::ostream &os) const
+{
+    char header[format::seed_header_size];
+
+    std::memcpy(header, format::seed_magic, sizeof format::seed_magic);
+    header[4] = static_cast<char> (format::seed_version);
+    format::put_u32(header + 5, static_cast<std::uint32_t> (keys_.size()));
+
+    std::vector<char> stored {stored_keys(keys_)};
+
+    stored.resize(stored.size() + 4);
+    format::put_u32(&stored[stored.size() - 4], id_);
+
+    os.write(header, sizeof header);
+    os.write(stored.data(), static_cast<std::streamsize> (stored.size()));
+}
+
+
+Seed SeedDictionary::seed(unsigned int bits) const
+{
+    return Seed {keys_.data(), std::min(keys_.size(), capacity(bits))};
+}
+
+
+void SeedTrainer::add(const char *data, std::size_t size)
+{
+    const std::uint32_t none {0xffffffff};
+    std::uint32_t i {none};
+
+    for (const char *p = data; p != data + size; ++p)
+    {
+        if (i == none)
+        {
+            i = initial_code(*p);
+            continue;
+        }
+
+        const std::uint32_t key {i << 8 | static_cast<unsigned char> (*p)};
+        const auto found = codes_.find(key);
+
+        if (found != codes_.end())
+        {
+            i = found->second;
+            ++visits_[i - 256];
+            continue;
+        }
+
+        // the new string waits for the next time its prefix is matched, as in the encoder
+        if (keys_.size() < trie_limit)
+        {
+            codes_.emplace(key, static_cast<std::uint32_t> (256 + keys_.size()));
+            keys_.push_back(key);
+            visits_.push_back(0);
+        }
+
+        i = initial_code(*p);
+    }
+}
+
+
+SeedDictionary SeedTrainer::train(std::size_t size) const
+{
+    std::vector<std::uint32_t> order;
+
+    for (std::size_t n = 0; n < keys_.size(); ++n)
+        if (visits_[n] >= 2)
+            order.push_back(static_cast<std::uint32_t> (n));
+
+    // most visits first, and of two strings matched through as often, the shorter one, which comes first
+    const auto more_visits = [this](std::uint32_t a, std::uint32_t b) {
+        return visits_[a] != visits_[b] ? visits_[a] > visits_[b] : a < b;
+    };
+
+    size = std::min(std::min(size, max_seed_size), order.size());
+    std::nth_element(order.begin(), order.begin() + static_cast<std::ptrdiff_t> (size), order.end(), more_visits);
+    order.resize(size);
+    std::sort(order.begin(), order.end());
+
+    // the strings kept are numbered anew, in the order they were added
+    std::vector<std::uint32_t> renumbered(keys_.size());
+    std::vector<std::uint32_t> keys;
+
+    for (const std::uint32_t n : order)
+    {
+        const std::uint32_t prefix {keys_[n] >> 8};
+
+        keys.push_back((prefix < 256 ? prefix : renumbered[prefix - 256]) << 8 | (keys_[n] & 0xff));
+        renumbered[n] = static_cast<std::uint32_t> (256 + keys.size() - 1);
+    }
+
+    return SeedDictionary(std::move(keys));
+}
+
+
+void add_seed_dictionary(std::shared_ptr<const SeedDictionary> seed)
+{
+    Registry &seeds = registry();
+    std::lock_guard<std::mutex> lock(seeds.mutex);
+    const std::uint32_t id {seed->id()};
+
+    // a seed already there may be in use, and has the same strings anyway
+    seeds.seeds.emplace(id, std::move(seed));
+}
+
+
+const SeedDictionary &find_seed_dictionary(std::uint32_t id)
+{
+    Registry &seeds = registry();
+    std::lock_guard<std::mutex> lock(seeds.mutex);
+    const auto found = seeds.seeds.find(id);
+
+    if (found == seeds.seeds.end())
+    {
+        char name[9];
+
+        std::snprintf(name, sizeof name, "%08x", static_cast<unsigned int> (id));
+        throw std::runtime_error(std::string("seed dictionary ") + name + " not loaded");
+    }
+
+    return *found->second;
+}
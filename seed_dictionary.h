@@ -0,0 +1,145 @@
+#ifndef MEGALZW_SEED_DICTIONARY_H
+#define MEGALZW_SEED_DICTIONARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "dictionary.h"
+#include "lzw.h"
+
+
+/**
+     * Seed dictionaries: strings, trained from a sample of the data, that the
+     * dictionaries of the codec start from rather than from the 256 single
+     * bytes alone.
+     *
+     * A small file ends before its dictionary learns much; with a seed, its
+     * first codes can already stand for the strings common in files like it,
+     * such as the headers of BMP images. A file compressed with a seed records
+     * its ID, and decompressing it needs the same seed, so seeds are stored in
+     * files of their own, see format.h, and added to those the decoder knows
+     * with `add_seed_dictionary()`.
+*/
+
+/**
+     * Number of strings `SeedTrainer::train()` keeps when none is asked for,
+     * as many as a dictionary of the default code width takes.
+*/
+const std::size_t default_seed_size {((std::size_t {1} << default_code_width) - 1) / 2 - 256};
+
+/// Largest number of strings of a seed, whose prefix codes have to fit in 24 bits.
+const std::size_t max_seed_size {(std::size_t {1} << 24) - 256};
+
+
+/// The strings of a seed, see `Seed`, and the ID that files compressed with them record.
+class SeedDictionary
+{
+public:
+
+    /**
+     * @param keys     strings of the seed, as in `Seed`
+     * @throw std::invalid_argument if there are too many, or one is built on a string after it
+    */
+    explicit SeedDictionary(std::vector<std::uint32_t> keys);
+
+    /**
+     * Reads a seed dictionary file.
+     *
+     * @param [in] is  input stream
+     * @throw std::runtime_error if `is` is not a seed dictionary, or a corrupted one
+    */
+    static SeedDictionary load(std::istream &is);
+
+    /// Writes the seed dictionary file to `os`.
+    void save(std::ostream &os) const;
+
+    /// Returns the ID of the seed, the CRC-32C of its strings as the file stores them.
+    std::uint32_t id() const
+    {
+        return id_;
+    }
+
+    /// Returns the number of strings of the seed.
+    std::size_t size() const
+    {
+        return keys_.size();
+    }
+
+    /**
+     * Returns the strings a dictionary of codes at most `bits` wide starts
+     * from: the first ones, as many as `capacity(bits)`.
+    */
+    Seed seed(unsigned int bits) const;
+
+    /**
+     * Returns how many strings of a seed a dictionary of codes at most `bits`
+     * wide takes, half of its codes less the single bytes, so that the data
+     * still has room for strings of its own.
+    */
+    static std::size_t capacity(unsigned int bits)
+    {
+        return ((std::size_t {1} << bits) - 1) / 2 - 256;
+    }
+
+private:
+
+    std::vector<std::uint32_t> keys_;
+    std::uint32_t id_;
+};
+
+
+/**
+     * Trains a seed dictionary from sample files.
+     *
+     * The samples are parsed like the encoder does, growing a dictionary
+     * shared by all of them that is never reset, and every time a string is
+     * matched through counts. A string is matched through at least as often
+     * as those extending it, so the strings matched through most make up a
+     * seed in which every string is built on a single byte or another one.
+*/
+class SeedTrainer
+{
+public:
+
+    SeedTrainer() = default;
+
+    SeedTrainer(const SeedTrainer &) = delete;
+    SeedTrainer &operator=(const SeedTrainer &) = delete;
+
+    /// Parses the sample of `size` bytes at `data`.
+    void add(const char *data, std::size_t size);
+
+    /**
+     * Returns the seed of the `size` strings matched through most often in
+     * the samples so far, or of all those matched through at least twice if
+     * there are fewer.
+    */
+    SeedDictionary train(std::size_t size = default_seed_size) const;
+
+private:
+
+    /// Number of strings that the dictionary of the samples stops growing at.
+    static const std::size_t trie_limit {std::size_t {1} << 22};
+
+    std::unordered_map<std::uint32_t, std::uint32_t> codes_;   ///< code of every key
+    std::vector<std::uint32_t> keys_;       ///< key of code `256 + n`
+    std::vector<std::uint64_t> visits_;     ///< times code `256 + n` was matched through
+};
+
+
+/// Adds `seed` to the seeds that decompressing can find by their ID.
+void add_seed_dictionary(std::shared_ptr<const SeedDictionary> seed);
+
+/**
+     * Returns the seed added with `add_seed_dictionary()` whose ID is `id`.
+     *
+     * @throw std::runtime_error if there is none
+*/
+const SeedDictionary &find_seed_dictionary(std::uint32_t id);
+
+#endif // MEGALZW_SEED_DICTIONARY_H
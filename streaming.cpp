@@ -0,0 +1,292 @@
+#include "lzw.h"
+
+#include <stdexcept>
+
+#include "bitio.h"
+#include "codec.h"
+#include "format.h"
+#include "seed_dictionary.h"
+
+
+/// Compressor state behind `LzwEncoder`, for the code width and engine picked at run time.
+class LzwEncoder::Impl
+{
+public:
+
+    virtual ~Impl() = default;
+
+    virtual void feed(const char *data, std::size_t size, std::vector<char> &out) = 0;
+    virtual void finish(std::vector<char> &out) = 0;
+};
+
+
+namespace {
+
+template <unsigned int Bits, typename Dictionary>
+class Encoder: public LzwEncoder::Impl
+{
+public:
+
+    /**
+     * @param header       common header, which leaves with the first codes
+     * @param clear_code   whether to keep a full dictionary until sending a clear code
+     * @param seed         strings both dictionaries start from
+    */
+    Encoder(const std::vector<char> &header, bool clear_code, const Seed &seed):
+        buffer_(header),
+        writer_(buffer_),
+        encoder_(clear_code, seed)
+    {
+    }
+
+    void feed(const char *data, std::size_t size, std::vector<char> &out) override
+    {
+        MemoryInput input {data, data + size};
+
+        encoder_.encode(input, writer_);
+        writer_.drain(out);
+    }
+
+    void finish(std::vector<char> &out) override
+    {
+        encoder_.finish(writer_);
+        writer_.finish();
+        writer_.drain(out);
+    }
+
+private:
+
+    std::vector<char> buffer_;  ///< codes not handed out yet
+    CodeWriter writer_;
+    CodeEncoder<Bits, Dictionary> encoder_;
+};
+
+
+template <unsigned int Bits>
+LzwEncoder::Impl *make_encoder(const std::vector<char> &header, const Options &options)
+{
+    const bool clear_code {options.full_dictionary == FullDictionary::Clear};
+    const Seed seed {options.seed != nullptr ? options.seed->seed(Bits) : no_seed};
+
+    if (options.full_dictionary == FullDictionary::Recycle)
+        return new Encoder<Bits, RecyclingDictionary<Bits>>(header, false, seed);
+
+    if (options.engine == DictionaryEngine::Map)
+        return new Encoder<Bits, MapDictionary<Bits>>(header, clear_code, seed);
+
+    return new Encoder<Bits, FlatDictionary<Bits>>(header, clear_code, seed);
+}
+
+} // namespace
+
+
+LzwEncoder::LzwEncoder(const Options &options)
+{
+    if (options.block_size != 0)
+        throw std::invalid_argument("blocks are not supported by the incremental compressor");
+
+    if (options.bmp_filter)
+        throw std::invalid_argument("the BMP filter is not supported by the incremental compressor");
+
+    std::vector<char> header {
+        format::magic[0], format::magic[1], format::magic[2], format::magic[3],
+        static_cast<char> (options.seed != nullptr ? format::version_seeded_stream : format::version_stream),
+        header_width(options)
+    };
+
+    if (options.seed != nullptr)
+    {
+        header.resize(format::header_size + format::seed_id_size);
+        format::put_u32(&header[format::header_size], options.seed->id());
+    }
+
+    switch (options.bits)
+    {
+        case 12:
+            impl_.reset(make_encoder<12>(header, options));
+            break;
+
+        case 16:
+            impl_.reset(make_encoder<16>(header, options));
+            break;
+
+        case 20:
+            impl_.reset(make_encoder<20>(header, options));
+            break;
+
+        case 24:
+            impl_.reset(make_encoder<24>(header, options));
+            break;
+
+        default:
+            throw std::invalid_argument("unsupported code width");
+    }
+}
+
+
+LzwEncoder::~LzwEncoder() = default;
+
+
+void LzwEncoder::feed(const char *data, std::size_t size, std::vector<char> &out)
+{
+    impl_->feed(data, size, out);
+}
+
+
+void LzwEncoder::finish(std::vector<char> &out)
+{
+    impl_->finish(out);
+}
+
+
+/// Decompressor state behind `LzwDecoder`, for the code width found in the header.
+class LzwDecoder::Impl
+{
+public:
+
+    virtual ~Impl() = default;
+
+    virtual void feed(const char *data, std::size_t size, std::vector<char> &out) = 0;
+    virtual void finish() = 0;
+};
+
+
+namespace {
+
+/// @tparam Codes     `CodeDecoder` or `RecyclingDecoder`
+template <typename Codes>
+class Decoder: public LzwDecoder::Impl
+{
+public:
+
+    explicit Decoder(const CodeFormat &code_format):
+        reader_(nullptr, nullptr),
+        decoder_(code_format)
+    {
+    }
+
+    void feed(const char *data, std::size_t size, std::vector<char> &out) override
+    {
+        VectorOutput output {out};
+
+        reader_.append(data, data + size);
+        decoder_.decode(reader_, output);
+    }
+
+    void finish() override
+    {
+        if (!reader_.clean_end())
+            throw std::runtime_error("corrupted compressed file");
+    }
+
+private:
+
+    CodeReader reader_;
+    Codes decoder_;
+};
+
+
+template <unsigned int Bits>
+LzwDecoder::Impl *make_decoder(const CodeFormat &code_format)
+{
+    if (code_format.full_dictionary == FullDictionary::Recycle)
+        return new Decoder<RecyclingDecoder<Bits>>(code_format);
+
+    return new Decoder<CodeDecoder<Bits>>(code_format);
+}
+
+} // namespace
+
+
+LzwDecoder::LzwDecoder() = default;
+
+
+LzwDecoder::~LzwDecoder() = default;
+
+
+void LzwDecoder::feed(const char *data, std::size_t size, std::vector<char> &out)
+{
+    if (!impl_)
+    {
+        // the version is only known once the header is complete, and version 4 files follow it with their seed
+        for (std::size_t header_size = format::header_size; ; header_size += format::seed_id_size)
+        {
+            const std::size_t count {std::min(size, header_size - std::min(header_size, header_.size()))};
+
+            header_.insert(header_.end(), data, data + count);
+            data += count;
+            size -= count;
+
+            if (header_.size() < header_size)
+                return;
+
+            if (header_size != format::header_size || !format::has_magic(header_.data())
+                || static_cast<std::uint8_t> (header_[4]) != format::version_seeded_stream)
+                break;
+        }
+
+        if (!format::has_magic(header_.data()))
+        {
+            // a version 0 file has no header, what was read is already its first codes
+            impl_.reset(make_decoder<16>(legacy_code_format));
+            impl_->feed(header_.data(), header_.size(), out);
+        }
+        else
+        {
+            const std::uint8_t version {static_cast<std::uint8_t> (header_[4])};
+
+            if (version != format::version_stream && version != format::version_seeded_stream)
+                throw std::runtime_error("unsupported file format version");
+
+            if (format::has_bmp_filter(header_.data()))
+                throw std::runtime_error("filtered files are not supported by the incremental decompressor");
+
+            CodeFormat code_format {header_code_format(header_.data())};
+
+            if (version == format::version_seeded_stream && supported_code_width(code_format.bits))
+                code_format.seed = find_seed_dictionary(format::get_u32(&header_[format::header_size]))
+                                   .seed(code_format.bits);
+
+            switch (code_format.bits)
+            {
+                case 12:
+                    impl_.reset(make_decoder<12>(code_format));
+                    break;
+
+                case 16:
+                    impl_.reset(make_decoder<16>(code_format));
+                    break;
+
+                case 20:
+                    impl_.reset(make_decoder<20>(code_format));
+                    break;
+
+                case 24:
+                    impl_.reset(make_decoder<24>(code_format));
+                    break;
+
+                default:
+                    throw std::runtime_error("unsupported code width");
+            }
+        }
+    }
+
+    impl_->feed(data, size, out);
+}
+
+
+void LzwDecoder::finish(std::vector<char> &out)
+{
+    if (!impl_)
+    {
+        // a version 4 file cut short in its seed
+        if (header_.size() >= format::header_size && format::has_magic(header_.data()))
+            throw std::runtime_error("corrupted compressed file");
+
+        // a version 0 file shorter than a header
+        impl_.reset(make_decoder<16>(legacy_code_format));
+        impl_->feed(header_.data(), header_.size(), out);
+    }
+
+    impl_->finish();
+}
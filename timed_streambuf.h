@@ -0,0 +1,152 @@
+#ifndef MEGALZW_TIMED_STREAMBUF_H
+#define MEGALZW_TIMED_STREAMBUF_H
+
+#include <chrono>
+#include <cstdint>
+#include <streambuf>
+
+#include "progress.h"
+
+
+/**
+     * Stream buffer forwarding to another one, counting the bytes that go
+     * through it and the time spent in the other buffer.
+     *
+     * It keeps no buffer of its own, so every read and write is forwarded;
+     * the codec reads and writes whole chunks, which keeps that cheap. The
+     * bytes read also advance a `ProgressObserver`, if it is given one.
+*/
+class TimedStreambuf: public std::streambuf
+{
+public:
+
+    explicit TimedStreambuf(std::streambuf &target, ProgressObserver *progress = nullptr):
+        target_(target),
+        progress_ {progress},
+        bytes_ {0},
+        seconds_ {0}
+    {
+    }
+
+    /// Returns the number of bytes read or written.
+    std::uint64_t bytes() const
+    {
+        return bytes_;
+    }
+
+    /// Returns the seconds spent reading, writing and seeking.
+    double seconds() const
+    {
+        return seconds_;
+    }
+
+protected:
+
+    std::streamsize xsgetn(char *s, std::streamsize n) override
+    {
+        const Timer timer(seconds_);
+
+        n = target_.sgetn(s, n);
+        bytes_ += static_cast<std::uint64_t> (n);
+
+        if (progress_ != nullptr)
+            progress_->advance(static_cast<std::uint64_t> (n));
+
+        return n;
+    }
+
+    int_type underflow() override
+    {
+        const Timer timer(seconds_);
+
+        return target_.sgetc();
+    }
+
+    int_type uflow() override
+    {
+        const Timer timer(seconds_);
+        const int_type c {target_.sbumpc()};
+
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            ++bytes_;
+
+            if (progress_ != nullptr)
+                progress_->advance(1);
+        }
+
+        return c;
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override
+    {
+        const Timer timer(seconds_);
+
+        n = target_.sputn(s, n);
+        bytes_ += static_cast<std::uint64_t> (n);
+        return n;
+    }
+
+    int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+
+        const Timer timer(seconds_);
+
+        ++bytes_;
+        return target_.sputc(traits_type::to_char_type(c));
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+    {
+        const Timer timer(seconds_);
+
+        return target_.pubseekoff(off, dir, which);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        const Timer timer(seconds_);
+
+        return target_.pubseekpos(pos, which);
+    }
+
+    int sync() override
+    {
+        const Timer timer(seconds_);
+
+        return target_.pubsync();
+    }
+
+private:
+
+    /// Adds the time from its construction to its destruction to a total.
+    class Timer
+    {
+    public:
+
+        explicit Timer(double &seconds):
+            seconds_(seconds),
+            start_ {std::chrono::steady_clock::now()}
+        {
+        }
+
+        ~Timer()
+        {
+            seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        }
+
+    private:
+
+        double &seconds_;
+        const std::chrono::steady_clock::time_point start_;
+    };
+
+    std::streambuf &target_;
+    ProgressObserver * const progress_;
+    std::uint64_t bytes_;
+    double seconds_;
+};
+
+#endif // MEGALZW_TIMED_STREAMBUF_H